@@ -1,8 +1,168 @@
 #include <queue>
 #include <set>
 #include <cctype>
+#include <climits>
+#include <algorithm>
 #include "ast.h"
 
+LineIndex line_index;
+
+void LineIndex::lookup(uint32_t offset, uint32_t &line, uint32_t &column) const {
+	line = upper_bound(line_start.begin(), line_start.end(), offset) - line_start.begin();
+	column = offset - line_start[line - 1] + 1;
+}
+
+// same format as bison's yy::location: line.column[-[line.]column]
+ostream& operator<<(ostream& os, const Location& loc) {
+	uint32_t begin_line, begin_column, end_line, end_column;
+	line_index.lookup(loc.begin, begin_line, begin_column);
+	line_index.lookup(loc.end, end_line, end_column);
+	end_column--;
+	os << begin_line << '.' << begin_column;
+	if (begin_line < end_line)
+		os << '-' << end_line << '.' << end_column;
+	else if (begin_column < end_column)
+		os << '-' << end_column;
+	return os;
+}
+
+ASTStore ast_store;
+
+static const size_t AST_BLOCK_SIZE = 64 * 1024;
+
+void* ASTStore::allocate(size_t size) {
+	size = (size + alignof(max_align_t) - 1) & ~(alignof(max_align_t) - 1);
+	if (size > AST_BLOCK_SIZE) {
+		// a block of its own, counted as full
+		blocks.push_back(new char[size]);
+		block_used = AST_BLOCK_SIZE;
+		return blocks.back();
+	}
+	if (blocks.empty() || block_used + size > AST_BLOCK_SIZE) {
+		blocks.push_back(new char[AST_BLOCK_SIZE]);
+		block_used = 0;
+	}
+	void *p = blocks.back() + block_used;
+	block_used += size;
+	return p;
+}
+
+uint32_t ASTStore::add(ASTNode *node, uint8_t kind) {
+	nodes.push_back(node);
+	kinds.push_back(kind);
+	locs.push_back(Location());
+	payloads.push_back(0);
+	child_begin.push_back(child_index.size());
+	child_count.push_back(0);
+	child_capacity.push_back(0);
+	return nodes.size() - 1;
+}
+
+void ASTStore::append(uint32_t owner, ASTNode *child) {
+	uint32_t begin = child_begin[owner], count = child_count[owner];
+	if (count == child_capacity[owner]) {
+		if (begin + count == child_index.size()) {
+			// last range in child_index, grow it in place
+			child_index.push_back(0);
+			child_capacity[owner]++;
+		}
+		else {
+			// move the range to the end, leaving room to grow
+			uint32_t capacity = max(count * 2, uint32_t(4));
+			child_begin[owner] = child_index.size();
+			child_index.resize(child_index.size() + capacity);
+			copy(child_index.begin() + begin, child_index.begin() + begin + count,
+					child_index.begin() + child_begin[owner]);
+			child_capacity[owner] = capacity;
+			begin = child_begin[owner];
+		}
+	}
+	child_index[begin + count] = child->getIndex();
+	child_count[owner]++;
+}
+
+void ASTStore::replace(uint32_t owner, uint32_t i, ASTNode *child) {
+	child_index[child_begin[owner] + i] = child->getIndex();
+}
+
+// renumber the nodes reachable from root in depth-first order and drop
+// everything else, so that a walk of the tree scans the arrays front to back
+void ASTStore::compact(ASTNode *root) {
+	const uint32_t UNVISITED = UINT32_MAX;
+	vector<uint32_t> new_id(nodes.size(), UNVISITED);
+	vector<uint32_t> order;
+	vector<uint32_t> stack(1, root->getIndex());
+	while (!stack.empty()) {
+		uint32_t id = stack.back();
+		stack.pop_back();
+		if (new_id[id] != UNVISITED)
+			continue;
+		new_id[id] = order.size();
+		order.push_back(id);
+		for (uint32_t i = child_count[id]; i > 0; --i)
+			stack.push_back(child_index[child_begin[id] + i - 1]);
+	}
+
+	// e.g. elif lists, whose children were taken over by the if statement
+	for (uint32_t id = 0; id < nodes.size(); ++id)
+		if (new_id[id] == UNVISITED)
+			delete nodes[id];
+
+	vector<ASTNode *> new_nodes(order.size());
+	vector<uint8_t> new_kinds(order.size());
+	vector<Location> new_locs(order.size());
+	vector<int32_t> new_payloads(order.size());
+	vector<uint32_t> new_begin(order.size()), new_count(order.size());
+	vector<uint32_t> new_index;
+	new_index.reserve(order.size());
+	for (uint32_t id = 0; id < order.size(); ++id) {
+		uint32_t old = order[id];
+		new_nodes[id] = nodes[old];
+		new_nodes[id]->setIndex(id);
+		new_kinds[id] = kinds[old];
+		new_locs[id] = locs[old];
+		new_payloads[id] = payloads[old];
+		new_begin[id] = new_index.size();
+		new_count[id] = child_count[old];
+		for (uint32_t i = 0; i < child_count[old]; ++i)
+			new_index.push_back(new_id[child_index[child_begin[old] + i]]);
+	}
+	nodes.swap(new_nodes);
+	kinds.swap(new_kinds);
+	locs.swap(new_locs);
+	payloads.swap(new_payloads);
+	child_begin.swap(new_begin);
+	child_count = new_count;
+	child_capacity.swap(new_count);
+	child_index.swap(new_index);
+}
+
+void ASTStore::clear() {
+	for (uint32_t id = 0; id < nodes.size(); ++id)
+		delete nodes[id];
+	nodes.clear();
+	kinds.clear();
+	locs.clear();
+	payloads.clear();
+	child_begin.clear();
+	child_count.clear();
+	child_capacity.clear();
+	child_index.clear();
+	for (char *block : blocks)
+		delete[] block;
+	blocks.clear();
+	block_used = 0;
+}
+
+uint32_t ASTStore::intern(const string &s) {
+	auto iter = name_ids.find(s);
+	if (iter != name_ids.end())
+		return iter->second;
+	names.push_back(s);
+	name_ids[s] = names.size() - 1;
+	return names.size() - 1;
+}
+
 static map<string, ASTNodeArrayDecl*> array_table;
 static map<string, pair<ASTNodeType*, ASTNodeClassBody*>> class_table;
 static map<string, ASTNodeFunctionDefn*> g_func_table;
@@ -13,113 +173,312 @@ static map<string, int> str_table;
 static const char BREAK_FLAG = '\x80';
 static const char CONTINUE_FLAG = '\x81';
 static const char HOLE_WIDTH = 4;
-
-string ASTNodeType::getTypeAsm(bool array_ref) {
-	if (variable_type == VariableType::INTEGER ||
-			variable_type == VariableType::BOOLEAN)
-		return asm_str;
-	else if (variable_type == VariableType::VOID)
-		return "void";
-	else if (array_table.find(value) != array_table.end()) {
-		string ret = dynamic_cast<ASTNodeType*>(array_table[value]->getChildren()[2])->getAsm();
-		if (array_ref)
-			ret += "*";
-		return ret;
-	}
-	else if (class_table.find(value) != class_table.end())
-		return "%class." + value;
+// brackets the number of a label not yet known, see gen_cond()
+static const char LABEL_FLAG = '\x82';
+static int label_hole_count = 0;
+// locals larger than this (in bytes) don't go on the stack, those of main()
+// become globals and the others are taken from the arena
+static const int LARGE_LOCAL_SIZE = 1 << 16;
+// elif chains with at least this many arms over one variable become a switch
+static const int SWITCH_MIN_CASES = 3;
+// a callee of at most this many instructions is always inlined, a larger one
+// while its size times its number of call sites stays within the growth, and
+// none into a function which reached the caller size
+static const int INLINE_SIZE = 40;
+static const int INLINE_GROWTH = 160;
+static const int INLINE_CALLER_SIZE = 4000;
+static int inline_count = 0;
+// functions of at most this many instructions are cloned for constant
+// arguments, as long as the clones stay within the growth
+static const int SPECIALIZE_SIZE = 200;
+static const int SPECIALIZE_GROWTH = 600;
+static int specialize_count = 0;
+
+static map<string, Type*> type_table;
+
+bool reorder_fields = false;
+bool pack_bool_arrays = false;
+
+// arrays and classes which are printed, each gets a @dragon.print.<name>
+static set<Type*> print_table;
+static vector<Type*> print_queue;
+// whether the module prints or takes locals from the arena, see gen_runtime()
+static bool uses_runtime = false;
+
+Type::Type(const string &value, ASTNodeType::VariableType type, const string &as)
+	: variable_type(type), value(value), asm_str(as), ref_asm_str(as),
+	reg_asm_str(type == ASTNodeType::BOOLEAN ? "i1" : as), size(-1), align(-1),
+	array_decl(NULL), element(NULL), length(0), packed(false), class_body(NULL), super(NULL), layout(NULL) {}
+
+Type* Type::get(const string &name) {
+	auto iter = type_table.find(name);
+	if (iter != type_table.end())
+		return iter->second;
+	Type *type;
+	if (name == "integer")
+		type = new Type(name, ASTNodeType::INTEGER, "i32");
+	else if (name == "boolean")
+		type = new Type(name, ASTNodeType::BOOLEAN, "i8");
 	else
-		return "";
+		type = new Type(name, ASTNodeType::UNKNOWN, "");
+	type_table[name] = type;
+	return type;
+}
+
+Type* Type::get(ASTNodeType::VariableType type) {
+	static Type *integer_type = get("integer");
+	static Type *boolean_type = get("boolean");
+	// 'void' can't be named in MyLang, so it is not in type_table
+	static Type *void_type = new Type("", ASTNodeType::VOID, "void");
+	if (type == ASTNodeType::INTEGER)
+		return integer_type;
+	else if (type == ASTNodeType::BOOLEAN)
+		return boolean_type;
+	else if (type == ASTNodeType::VOID)
+		return void_type;
+	throw runtime_error("panic: unexpected code path, BUG in code!\n");
+}
+
+void Type::setArray(ASTNodeArrayDecl *decl, Type *element, int length) {
+	variable_type = ASTNodeType::ARRAY;
+	array_decl = decl;
+	this->element = element;
+	this->length = length;
+	packed = pack_bool_arrays && element->variableType() == ASTNodeType::BOOLEAN;
+}
+
+void Type::setAsm(const string &as) {
+	asm_str = as;
+	ref_asm_str = reg_asm_str = as + "*";
+}
+
+void Type::setClass(ASTNodeClassBody *body, Type *super) {
+	variable_type = ASTNodeType::CLASS;
+	class_body = body;
+	this->super = super;
+	asm_str = ref_asm_str = reg_asm_str = "%class." + value;
+}
+
+int Type::getSize() {
+	compute_layout();
+	return size;
+}
+
+int Type::getAlign() {
+	compute_layout();
+	return align;
+}
+
+int Type::getAlign(bool array_ref) {
+	if (array_ref && variable_type == ASTNodeType::ARRAY)
+		return 8;
+	return getAlign();
+}
+
+// size and alignment as laid out by LLVM, only valid after gen_typedef()
+void Type::compute_layout() {
+	if (size >= 0)
+		return;
+	// guards against recursion through invalid (circular) declarations
+	size = 0;
+	align = 1;
+	if (variable_type == ASTNodeType::INTEGER)
+		size = align = 4;
+	else if (variable_type == ASTNodeType::BOOLEAN)
+		size = align = 1;
+	else if (variable_type == ASTNodeType::ARRAY && packed) {
+		size = (length + 31) / 32 * 4;
+		align = 4;
+	}
+	else if (variable_type == ASTNodeType::ARRAY) {
+		size = length * element->getSize();
+		align = element->getAlign();
+	}
+	else if (variable_type == ASTNodeType::CLASS) {
+		size = getLayout().size;
+		align = getLayout().align;
+	}
+}
+
+const ClassLayout& Type::getLayout() {
+	if (layout)
+		return *layout;
+	layout = new ClassLayout();
+	// what is seen when reached again through circular declarations
+	layout->size = 0;
+	layout->align = 1;
+	int offset = 0, max_align = 1;
+	// the super class is the first element of the struct
+	int first_index = 0;
+	if (super->variableType() != ASTNodeType::VOID) {
+		const ClassLayout &base = super->getLayout();
+		for (auto i : base.fields) {
+			i.second.path.insert(i.second.path.begin(), 0);
+			i.second.depth++;
+			layout->fields.insert(i);
+		}
+		for (auto i : base.methods) {
+			i.second.depth++;
+			layout->methods.insert(i);
+		}
+		offset = super->getSize();
+		max_align = super->getAlign();
+		first_index = 1;
+	}
+
+	map<string, pair<int, ASTNodeType*>>* var_table = class_body->getVarTable();
+	vector<pair<uint32_t, Type*>> vars(var_table->size());
+	for (auto i : *var_table)
+		vars[i.second.first] = make_pair(ast_store.intern(i.first), i.second.second->getType());
+	// the super class stays in front, only the class's own fields are moved
+	vector<int> order(vars.size());
+	for (int i = 0; i < order.size(); ++i)
+		order[i] = i;
+	if (reorder_fields)
+		stable_sort(order.begin(), order.end(),
+			[&vars](int a, int b) { return vars[a].second->getAlign() > vars[b].second->getAlign(); });
+	for (int i = 0; i < order.size(); ++i) {
+		Type *type = vars[order[i]].second;
+		int field_align = type->getAlign();
+		offset = (offset + field_align - 1) / field_align * field_align;
+		ClassLayout::Field field = { vector<int>(1, first_index + i), offset, 0, order[i], type };
+		layout->fields[vars[order[i]].first] = field;
+		offset += type->getSize();
+		max_align = max(max_align, field_align);
+	}
+	// methods of the class override those of its super class
+	for (auto i : *class_body->getFuncTable()) {
+		ClassLayout::Method method = { 0, this, i.second };
+		layout->methods[ast_store.intern(i.first)] = method;
+	}
+
+	// see gen_typedef(), an empty class holds an i8
+	if (offset == 0)
+		offset = 1;
+	layout->size = (offset + max_align - 1) / max_align * max_align;
+	layout->align = max_align;
+	return *layout;
 }
 
 void ASTNodeProgram::collect_info() {
-	str_table["\n"] = 0;
-	str_table[" "] = 1;
-	str_table["%d"] = 2;
-	str_count = 3;
 	ASTNode::collect_info();
 }
 
-void ASTNodeString::collect_info() {
+static void add_string(const string &value) {
 	if (str_table.find(value) == str_table.end()) {
 		str_table[value] = str_count;
 		str_count++;
 	}
 }
 
-pair<bool, int> ASTNodeBinaryExpr::eval() {
-	if (op == ":=")
-		return make_pair(false, 0);
-	auto expr1 = dynamic_cast<ASTNodeExpression*>(children[0])->eval();
-	if (!expr1.first)
-		return make_pair(false, 0);
-	auto expr2 = dynamic_cast<ASTNodeExpression*>(children[1])->eval();
-	if (!expr2.first)
-		return make_pair(false, 0);
+void ASTNodeString::collect_info() { add_string(getValue()); }
+
+static bool is_literal(ASTNode *node) {
+	return node->type() == ASTNode::STRING || node->type() == ASTNode::INTEGER ||
+		node->type() == ASTNode::BOOLEAN;
+}
+
+void ASTNodePrintStmt::collect_info() {
+	ChildList expr_list = children[0]->getChildren();
+	uses_runtime = true;
+	stringstream text;
+	for (int i = 0; i < expr_list.size(); ++i) {
+		ASTNode *expr = expr_list[i];
+		if (expr->type() == ASTNode::STRING)
+			text << dynamic_cast<ASTNodeString*>(expr)->getValue();
+		else if (expr->type() == ASTNode::INTEGER)
+			text << dynamic_cast<ASTNodeInteger*>(expr)->getValue();
+		else if (expr->type() == ASTNode::BOOLEAN)
+			text << int(dynamic_cast<ASTNodeBoolean*>(expr)->getValue());
+		else
+			expr->collect_info();
+		if (is_literal(expr) && (i + 1 == expr_list.size() || !is_literal(expr_list[i + 1]))) {
+			texts.push_back(text.str());
+			add_string(text.str());
+			text.str("");
+		}
+	}
+}
+
+// folds a binary operator over constants, a division by zero isn't folded
+static pair<bool, int> fold_binary(const string &op, int left, int right) {
 	if (op == "or")
-		return make_pair(true, bool(expr1.second) || bool(expr2.second));
+		return make_pair(true, bool(left) || bool(right));
 	else if (op == "and")
-		return make_pair(true, bool(expr1.second) && bool(expr2.second));
+		return make_pair(true, bool(left) && bool(right));
 	else if (op == "|")
-		return make_pair(true, expr1.second | expr2.second);
+		return make_pair(true, left | right);
 	else if (op == "^")
-		return make_pair(true, expr1.second ^ expr2.second);
+		return make_pair(true, left ^ right);
 	else if (op == "&")
-		return make_pair(true, expr1.second & expr2.second);
+		return make_pair(true, left & right);
 	else if (op == "==")
-		return make_pair(true, int(expr1.second == expr2.second));
+		return make_pair(true, int(left == right));
 	else if (op == "!=")
-		return make_pair(true, int(expr1.second != expr2.second));
+		return make_pair(true, int(left != right));
 	else if (op == "<=")
-		return make_pair(true, int(expr1.second <= expr2.second));
+		return make_pair(true, int(left <= right));
 	else if (op == ">=")
-		return make_pair(true, int(expr1.second >= expr2.second));
+		return make_pair(true, int(left >= right));
 	else if (op == "<")
-		return make_pair(true, int(expr1.second < expr2.second));
+		return make_pair(true, int(left < right));
 	else if (op == ">")
-		return make_pair(true, int(expr1.second > expr2.second));
+		return make_pair(true, int(left > right));
 	else if (op == "<<")
-		return make_pair(true, expr1.second << expr2.second);
+		return make_pair(true, left << right);
 	else if (op == ">>")
-		return make_pair(true, expr1.second >> expr2.second);
+		return make_pair(true, left >> right);
 	else if (op == "+")
-		return make_pair(true, expr1.second + expr2.second);
+		return make_pair(true, left + right);
 	else if (op == "-")
-		return make_pair(true, expr1.second - expr2.second);
+		return make_pair(true, left - right);
 	else if (op == "*")
-		return make_pair(true, expr1.second * expr2.second);
-	else if (op == "/" || op == "%") {
-		if (expr2.second == 0) {
-			stringstream ss;
-			ss << loc << " error: divide by zero" << endl;
-			throw runtime_error(ss.str());
-		}
+		return make_pair(true, left * right);
+	else if ((op == "/" || op == "%") && right != 0) {
 		if (op == "/")
-			return make_pair(true, expr1.second / expr2.second);
-		if (op == "%")
-			return make_pair(true, expr1.second % expr2.second);
+			return make_pair(true, left / right);
+		else
+			return make_pair(true, left % right);
 	}
 	return make_pair(false, 0);
 }
 
+pair<bool, int> ASTNodeBinaryExpr::eval() {
+	if (op == ":=")
+		return make_pair(false, 0);
+	auto expr1 = dynamic_cast<ASTNodeExpression*>(children[0])->eval();
+	if (!expr1.first)
+		return make_pair(false, 0);
+	auto expr2 = dynamic_cast<ASTNodeExpression*>(children[1])->eval();
+	if (!expr2.first)
+		return make_pair(false, 0);
+	if ((op == "/" || op == "%") && expr2.second == 0) {
+		stringstream ss;
+		ss << getLoc() << " error: divide by zero" << endl;
+		throw runtime_error(ss.str());
+	}
+	return fold_binary(op, expr1.second, expr2.second);
+}
+
 void ASTNodeArrayDecl::collect_info() {
 	string id = dynamic_cast<ASTNodeID*>(children[0])->getID();
 	stringstream ss;
 	if ((array_table.find(id) != array_table.end()) ||
 			(class_table.find(id) != class_table.end())) {
-		ss << loc << " error: redeclaration of array type '" << id << "'" << endl;
+		ss << getLoc() << " error: redeclaration of array type '" << id << "'" << endl;
 		throw runtime_error(ss.str());
 	}
 	auto length = dynamic_cast<ASTNodeExpression*>(children[1])->eval();
 	if (!length.first) {
-		ss << loc << " error: array length of array type '" << id << "' is not a constant expression" << endl;
+		ss << getLoc() << " error: array length of array type '" << id << "' is not a constant expression" << endl;
 		throw runtime_error(ss.str());
 	}
 	if (length.second <= 0) {
-		ss << loc << " error: array length of array type '" << id << "' is not positive" << endl;
+		ss << getLoc() << " error: array length of array type '" << id << "' is not positive" << endl;
 		throw runtime_error(ss.str());
 	}
 	this->length = length.second;
+	this->type = Type::get(id);
 	array_table[id] = this;
 }
 
@@ -129,25 +488,25 @@ void ASTNodeClassDecl::collect_info() {
 	ASTNodeClassBody* superclass_body;
 	if ((class_table.find(id) != class_table.end()) ||
 			(array_table.find(id) != array_table.end())) {
-		ss << loc << " error: redeclaration of class type '" << id << "'" << endl;
+		ss << getLoc() << " error: redeclaration of class type '" << id << "'" << endl;
 		throw runtime_error(ss.str());
 	}
 	ASTNodeType *super = dynamic_cast<ASTNodeType*>(children[1]);
 	if ((super->variableType() == ASTNodeType::INTEGER) ||
 			(super->variableType() == ASTNodeType::BOOLEAN)) {
-		ss << loc << " error: super class of class type '" << id
+		ss << getLoc() << " error: super class of class type '" << id
 			<< "' is declared to be " << super->getValue() << endl;
 		throw runtime_error(ss.str());
 	}
 	if (super->variableType() != ASTNodeType::VOID) {
 		if (array_table.find(super->getValue()) != array_table.end()) {
-			ss << loc << " error: super class of class type '" << id
+			ss << getLoc() << " error: super class of class type '" << id
 				<< "' is declared to be array type '" << super->getValue() << "'" << endl;
 			throw runtime_error(ss.str());
 		}
 		auto iter = class_table.find(super->getValue());
 		if (iter == class_table.end()) {
-			ss << loc << " error: super class of class type '" << id
+			ss << getLoc() << " error: super class of class type '" << id
 				<< "' is declared to be undeclared type '" << super->getValue() << "'" << endl;
 			throw runtime_error(ss.str());
 		}
@@ -210,11 +569,11 @@ void ASTNodeFunctionDefn::collect_info(map<string, ASTNodeFunctionDefn*> &func_t
 	string id = dynamic_cast<ASTNodeID*>(children[0])->getID();
 	stringstream ss;
 	if (func_table.find(id) != func_table.end()) {
-		ss << loc << " error: redefinition of function '" << id << "'" << endl;
+		ss << getLoc() << " error: redefinition of function '" << id << "'" << endl;
 		throw runtime_error(ss.str());
 	}
-	vector<ASTNode*>& param_list = children[1]->getChildren();
-	vector<ASTNode*>& param_decl = children[2]->getChildren();
+	ChildList param_list = children[1]->getChildren();
+	ChildList param_decl = children[2]->getChildren();
 	if (param_list.size() != param_decl.size()) {
 		ss << children[2]->getLoc() << " error: parameter declaration of function '" << id
 			<< "' is not consistent" << endl;
@@ -241,7 +600,7 @@ void ASTNodeFunctionDefn::collect_info(map<string, ASTNodeFunctionDefn*> &func_t
 		}
 	}
 
-	vector<ASTNode*>& local_decl = children[4]->getChildren();
+	ChildList local_decl = children[4]->getChildren();
 	for (int i = 0; i < local_decl.size(); ++i) {
 		string local_id = dynamic_cast<ASTNodeID*>
 			(dynamic_cast<ASTNodeVariableDecl*>(local_decl[i])->getChildren()[0])->getID();
@@ -255,77 +614,1946 @@ void ASTNodeFunctionDefn::collect_info(map<string, ASTNodeFunctionDefn*> &func_t
 				<< local_id << "' conflicts with a parameter" << endl;
 			throw runtime_error(ss.str());
 		}
-		localvar_table[local_id] = dynamic_cast<ASTNodeType*>(local_decl[i]->getChildren()[1]);
+		localvar_table[local_id] = dynamic_cast<ASTNodeType*>(local_decl[i]->getChildren()[1]);
+	}
+
+	func_table[id] = this;
+	children[5]->collect_info();
+}
+
+//---------------------------Name Resolution-----------------------------
+
+struct ResolveInfo {
+	Type* this_type;
+	map<string, ASTNodeFunctionDefn*>* func_table;
+	map<string, pair<int, ASTNodeType*>>* params;
+	map<string, ASTNodeType*>* localvar_table;
+	set<string>* written_params;
+};
+
+// the variable an access path like a.b[i].c starts from
+static ASTNodeID* root_id(ASTNode *node) {
+	while (node->type() == ASTNode::FIELD_ACCESS || node->type() == ASTNode::ARRAY_ACCESS)
+		node = node->getChildren()[0];
+	return node->type() == ASTNode::IDENTIFIER ? dynamic_cast<ASTNodeID*>(node) : NULL;
+}
+
+static void mark_written(ResolveInfo *info, ASTNode *node) {
+	ASTNodeID *id = root_id(node);
+	if (id && id->getBinding().kind == Binding::PARAM && info->written_params)
+		info->written_params->insert(id->getID());
+}
+
+// an identifier which stays UNRESOLVED is reported by the code generator
+void ASTNodeID::resolve(ResolveInfo *info) {
+	const string &id = getID();
+	if (info->params && info->params->find(id) != info->params->end()) {
+		pair<int, ASTNodeType*> &param = (*info->params)[id];
+		binding.kind = Binding::PARAM;
+		binding.slot = param.first;
+		binding.type = param.second->getType();
+	}
+	else if (info->localvar_table &&
+			info->localvar_table->find(id) != info->localvar_table->end()) {
+		binding.kind = Binding::LOCAL;
+		binding.type = (*info->localvar_table)[id]->getType();
+	}
+	else if (info->this_type) {
+		const ClassLayout &layout = info->this_type->getLayout();
+		auto field = layout.fields.find(getNameId());
+		if (field != layout.fields.end()) {
+			binding.kind = Binding::FIELD;
+			binding.type = field->second.type;
+			binding.path = &field->second.path;
+		}
+	}
+}
+
+void ASTNodeID::resolve_function(ResolveInfo *info) {
+	const string &id = getID();
+	auto iter = g_func_table.find(id);
+	if (iter != g_func_table.end()) {
+		binding.kind = Binding::FUNCTION;
+		binding.func = iter->second;
+	}
+	else if (info->func_table && info->func_table->find(id) != info->func_table->end()) {
+		binding.kind = Binding::METHOD;
+		binding.func = (*info->func_table)[id];
+	}
+}
+
+void ASTNodeMethodInvocation::resolve(ResolveInfo *info) {
+	if (children[0]->type() == ASTNode::IDENTIFIER)
+		dynamic_cast<ASTNodeID*>(children[0])->resolve_function(info);
+	else {
+		children[0]->resolve(info);
+		// the object is passed as 'this'
+		mark_written(info, children[0]->getChildren()[0]);
+	}
+	children[1]->resolve(info);
+	// a member of a parameter may be an array, which is passed by reference,
+	// and so is an array parameter itself
+	ChildList args = children[1]->getChildren();
+	for (int i = 0; i < args.size(); ++i) {
+		ASTNodeID *id = dynamic_cast<ASTNodeID*>(args[i]);
+		if (id == NULL || (id->getBinding().type &&
+				id->getBinding().type->variableType() == ASTNodeType::ARRAY))
+			mark_written(info, args[i]);
+	}
+}
+
+void ASTNodeBinaryExpr::resolve(ResolveInfo *info) {
+	ASTNode::resolve(info);
+	if (op == ":=")
+		mark_written(info, children[0]);
+}
+
+void ASTNodeFunctionDefn::resolve(Type *this_type, ASTNodeClassBody *class_body) {
+	ResolveInfo info = { this_type, class_body ? class_body->getFuncTable() : NULL,
+		&params, &localvar_table, &written_params };
+	children[5]->resolve(&info);
+}
+
+//-------------------------Constant Propagation--------------------------
+
+// Sparse conditional constant propagation over the integer and boolean locals
+// and parameters of a function body, run on the AST once names are resolved.
+// Uses of a variable known to hold a constant are replaced by a literal, so
+// the code generator folds what depends on them, including conditions, and
+// leaves out the arms such a condition never takes.
+
+struct ConstState {
+	ConstState() : reachable(true) {}
+	bool reachable;
+	// the constants held by variables, by name id, the others are unknown
+	map<uint32_t, int> values;
+};
+
+struct PropagateInfo {
+	bool rewrite; // replace uses by literals, off while a loop is iterated
+	vector<ConstState> breaks;
+	vector<ConstState> continues;
+};
+
+static void join_state(ConstState &state, const ConstState &other) {
+	if (!other.reachable)
+		return;
+	if (!state.reachable) {
+		state = other;
+		return;
+	}
+	for (auto i = state.values.begin(); i != state.values.end();) {
+		auto j = other.values.find(i->first);
+		if (j == other.values.end() || j->second != i->second)
+			i = state.values.erase(i);
+		else
+			++i;
+	}
+}
+
+static ASTNodeID* tracked_id(ASTNode *node) {
+	if (node->type() != ASTNode::IDENTIFIER)
+		return NULL;
+	ASTNodeID *id = dynamic_cast<ASTNodeID*>(node);
+	const Binding &binding = id->getBinding();
+	if (binding.kind != Binding::LOCAL && binding.kind != Binding::PARAM)
+		return NULL;
+	if (binding.type->variableType() != ASTNodeType::INTEGER &&
+			binding.type->variableType() != ASTNodeType::BOOLEAN)
+		return NULL;
+	return id;
+}
+
+// the value of the i-th child of parent, applying its assignments to state
+static pair<bool, int> propagate_expr(ASTNode *parent, int i, ConstState &state, PropagateInfo *info) {
+	ASTNode *node = parent->getChildren()[i];
+	ChildList children = node->getChildren();
+	if (node->type() == ASTNode::INTEGER || node->type() == ASTNode::BOOLEAN)
+		return dynamic_cast<ASTNodeExpression*>(node)->eval();
+	else if (node->type() == ASTNode::IDENTIFIER) {
+		ASTNodeID *id = tracked_id(node);
+		if (id == NULL || state.values.find(id->getNameId()) == state.values.end())
+			return make_pair(false, 0);
+		int value = state.values[id->getNameId()];
+		// a constant divisor of 0 is left to fail at run time as before
+		ASTNodeBinaryExpr *binary = dynamic_cast<ASTNodeBinaryExpr*>(parent);
+		bool divisor = binary && i == 1 && (binary->getOp() == "/" || binary->getOp() == "%");
+		if (info->rewrite && !(divisor && value == 0)) {
+			ASTNode *literal;
+			if (id->getBinding().type->variableType() == ASTNodeType::BOOLEAN)
+				literal = new ASTNodeBoolean(value != 0);
+			else
+				literal = new ASTNodeInteger(value);
+			literal->setLoc(node->getLoc());
+			parent->getChildren().replace(i, literal);
+		}
+		return make_pair(true, value);
+	}
+	else if (node->type() == ASTNode::BINARY_EXPR) {
+		const string &op = dynamic_cast<ASTNodeBinaryExpr*>(node)->getOp();
+		if (op == ":=") {
+			ASTNodeID *id = tracked_id(children[0]);
+			if (id == NULL)
+				propagate_expr(node, 0, state, info);
+			pair<bool, int> value = propagate_expr(node, 1, state, info);
+			if (id == NULL)
+				return make_pair(false, 0);
+			if (!value.first) {
+				state.values.erase(id->getNameId());
+				return value;
+			}
+			if (id->getBinding().type->variableType() == ASTNodeType::BOOLEAN)
+				value.second = value.second != 0;
+			state.values[id->getNameId()] = value.second;
+			return value;
+		}
+		pair<bool, int> left = propagate_expr(node, 0, state, info);
+		if (op == "and" || op == "or") {
+			// the right operand only runs when the left one doesn't decide
+			if (left.first && bool(left.second) == (op == "or"))
+				return make_pair(true, int(op == "or"));
+			ConstState right_state = state;
+			pair<bool, int> right = propagate_expr(node, 1, right_state, info);
+			if (left.first) {
+				state = right_state;
+				return make_pair(right.first, int(bool(right.second)));
+			}
+			join_state(state, right_state);
+			return make_pair(false, 0);
+		}
+		pair<bool, int> right = propagate_expr(node, 1, state, info);
+		if (!left.first || !right.first)
+			return make_pair(false, 0);
+		return fold_binary(op, left.second, right.second);
+	}
+	else if (node->type() == ASTNode::FIELD_ACCESS)
+		propagate_expr(node, 0, state, info);
+	else if (node->type() == ASTNode::ARRAY_ACCESS) {
+		propagate_expr(node, 0, state, info);
+		propagate_expr(node, 1, state, info);
+	}
+	else if (node->type() == ASTNode::METHOD_INVOCATION) {
+		if (children[0]->type() != ASTNode::IDENTIFIER)
+			propagate_expr(node, 0, state, info);
+		for (int j = 0; j < children[1]->getChildren().size(); ++j)
+			propagate_expr(children[1], j, state, info);
+	}
+	return make_pair(false, 0);
+}
+
+static void propagate_stmt(ASTNode *node, ConstState &state, PropagateInfo *info);
+
+// one pass over a loop entered in head, giving the state taken back to the
+// head and the one leaving the loop
+static void propagate_loop_pass(ASTNode *node, const ConstState &head,
+		ConstState &back, ConstState &exit, PropagateInfo *info) {
+	ChildList children = node->getChildren();
+	vector<ConstState> breaks = info->breaks, continues = info->continues;
+	info->breaks.clear();
+	info->continues.clear();
+	back = head;
+	if (node->type() == ASTNode::WHILE_STMT) {
+		pair<bool, int> cond = propagate_expr(node, 0, back, info);
+		exit = back;
+		if (cond.first && cond.second)
+			exit.reachable = false;
+		if (cond.first && !cond.second)
+			back.reachable = false;
+		propagate_stmt(children[1], back, info);
+		for (auto &i : info->continues)
+			join_state(back, i);
+	}
+	else if (node->type() == ASTNode::REPEAT_STMT) {
+		propagate_stmt(children[0], back, info);
+		for (auto &i : info->continues)
+			join_state(back, i);
+		if (back.reachable) {
+			pair<bool, int> cond = propagate_expr(node, 1, back, info);
+			exit = back;
+			if (cond.first && !cond.second)
+				exit.reachable = false;
+			if (cond.first && cond.second)
+				back.reachable = false;
+		}
+		else
+			exit = back;
+	}
+	else {
+		// foreach, the iterator takes each element in turn
+		ASTNodeID *id = tracked_id(children[0]);
+		if (id)
+			back.values.erase(id->getNameId());
+		exit = back;
+		propagate_stmt(children[2], back, info);
+		for (auto &i : info->continues)
+			join_state(back, i);
+	}
+	for (auto &i : info->breaks)
+		join_state(exit, i);
+	info->breaks = breaks;
+	info->continues = continues;
+}
+
+static void propagate_stmt(ASTNode *node, ConstState &state, PropagateInfo *info) {
+	if (!state.reachable)
+		return;
+	ChildList children = node->getChildren();
+	if (node->type() == ASTNode::BLOCK) {
+		for (int i = 0; i < children.size(); ++i)
+			propagate_stmt(children[i], state, info);
+	}
+	else if (node->type() == ASTNode::EXPR_STMT)
+		propagate_expr(node, 0, state, info);
+	else if (node->type() == ASTNode::PRINT_STMT) {
+		// literal arguments are merged by collect_info(), so variables are kept
+		ChildList args = children[0]->getChildren();
+		for (int i = 0; i < args.size(); ++i)
+			if (args[i]->type() != ASTNode::IDENTIFIER)
+				propagate_expr(children[0], i, state, info);
+	}
+	else if (node->type() == ASTNode::RETURN_STMT) {
+		if (!children.empty())
+			propagate_expr(node, 0, state, info);
+		state.reachable = false;
+	}
+	else if (node->type() == ASTNode::BREAK_STMT) {
+		info->breaks.push_back(state);
+		state.reachable = false;
+	}
+	else if (node->type() == ASTNode::CONTINUE_STMT) {
+		info->continues.push_back(state);
+		state.reachable = false;
+	}
+	else if (node->type() == ASTNode::IF_THEN_ELSE_STMT) {
+		ConstState out;
+		out.reachable = false;
+		int i;
+		for (i = 0; i + 1 < children.size(); i += 2) {
+			pair<bool, int> cond = propagate_expr(node, i, state, info);
+			if (cond.first && !cond.second)
+				continue;
+			ConstState arm = state;
+			propagate_stmt(children[i + 1], arm, info);
+			join_state(out, arm);
+			if (cond.first) {
+				// the following arms are never reached
+				state.reachable = false;
+				break;
+			}
+		}
+		if (i + 1 == children.size())
+			propagate_stmt(children[i], state, info);
+		join_state(out, state);
+		state = out;
+	}
+	else if (node->type() == ASTNode::WHILE_STMT || node->type() == ASTNode::REPEAT_STMT ||
+			node->type() == ASTNode::FOREACH_STMT) {
+		if (node->type() == ASTNode::FOREACH_STMT)
+			propagate_expr(node, 1, state, info);
+		// iterate from the state entering the loop until the head is stable,
+		// then rewrite the body once with it
+		bool rewrite = info->rewrite;
+		info->rewrite = false;
+		ConstState head = state, back, exit;
+		while (true) {
+			propagate_loop_pass(node, head, back, exit, info);
+			ConstState next = state;
+			join_state(next, back);
+			if (next.values == head.values)
+				break;
+			head = next;
+		}
+		info->rewrite = rewrite;
+		if (rewrite)
+			propagate_loop_pass(node, head, back, exit, info);
+		state = exit;
+	}
+}
+
+static void propagate_constants(ASTNode *body) {
+	ConstState state;
+	PropagateInfo info;
+	info.rewrite = true;
+	propagate_stmt(body, state, &info);
+}
+
+//-----------------------Algebraic Simplification------------------------
+
+// Rewrites the expression trees of a function body, after constant
+// propagation, with the algebraic properties of their operators: constant
+// operands go to the right, constants of an associative chain are gathered
+// and folded, and identities such as x + 0, x * 0 or x - x are applied, down
+// to literal nodes where the result is known.
+
+struct AlgebraRule {
+	enum Self {
+		SELF_NONE,
+		SELF_OPERAND,  // x op x == x
+		SELF_CONSTANT  // x op x == self
+	};
+	const char *swapped; // the operator with exchanged operands, NULL if none
+	bool associative;    // and commutative
+	bool has_identity;   // x op identity == x
+	int identity;
+	bool has_zero;       // x op zero == zero
+	int zero;
+	Self self_kind;
+	int self;
+};
+
+static const map<string, AlgebraRule> algebra_rules = {
+	//  op       swapped assoc  identity     zero          x op x
+	{ "+",   { "+",   true,  true,  0,  false, 0,  AlgebraRule::SELF_NONE,     0 } },
+	{ "-",   { NULL,  false, true,  0,  false, 0,  AlgebraRule::SELF_CONSTANT, 0 } },
+	{ "*",   { "*",   true,  true,  1,  true,  0,  AlgebraRule::SELF_NONE,     0 } },
+	{ "/",   { NULL,  false, true,  1,  false, 0,  AlgebraRule::SELF_NONE,     0 } },
+	{ "%",   { NULL,  false, false, 0,  false, 0,  AlgebraRule::SELF_NONE,     0 } },
+	{ "&",   { "&",   true,  true,  -1, true,  0,  AlgebraRule::SELF_OPERAND,  0 } },
+	{ "|",   { "|",   true,  true,  0,  true,  -1, AlgebraRule::SELF_OPERAND,  0 } },
+	{ "^",   { "^",   true,  true,  0,  false, 0,  AlgebraRule::SELF_CONSTANT, 0 } },
+	{ "<<",  { NULL,  false, true,  0,  false, 0,  AlgebraRule::SELF_NONE,     0 } },
+	{ ">>",  { NULL,  false, true,  0,  false, 0,  AlgebraRule::SELF_NONE,     0 } },
+	{ "and", { "and", false, true,  1,  true,  0,  AlgebraRule::SELF_OPERAND,  0 } },
+	{ "or",  { "or",  false, true,  0,  true,  1,  AlgebraRule::SELF_OPERAND,  0 } },
+	{ "==",  { "==",  false, false, 0,  false, 0,  AlgebraRule::SELF_CONSTANT, 1 } },
+	{ "!=",  { "!=",  false, false, 0,  false, 0,  AlgebraRule::SELF_CONSTANT, 0 } },
+	{ "<",   { ">",   false, false, 0,  false, 0,  AlgebraRule::SELF_CONSTANT, 0 } },
+	{ ">",   { "<",   false, false, 0,  false, 0,  AlgebraRule::SELF_CONSTANT, 0 } },
+	{ "<=",  { ">=",  false, false, 0,  false, 0,  AlgebraRule::SELF_CONSTANT, 1 } },
+	{ ">=",  { "<=",  false, false, 0,  false, 0,  AlgebraRule::SELF_CONSTANT, 1 } },
+};
+
+static bool is_logical(const string &op) {
+	return op == "and" || op == "or" || op == "==" || op == "!=" ||
+		op == "<" || op == ">" || op == "<=" || op == ">=";
+}
+
+// the type of a variable, element, field or call result when it is known
+// without generating it, NULL otherwise
+static Type* access_type(ASTNode *node) {
+	ChildList children = node->getChildren();
+	if (node->type() == ASTNode::IDENTIFIER) {
+		const Binding &binding = dynamic_cast<ASTNodeID*>(node)->getBinding();
+		if (binding.kind == Binding::LOCAL || binding.kind == Binding::PARAM ||
+				binding.kind == Binding::FIELD)
+			return binding.type;
+	}
+	else if (node->type() == ASTNode::ARRAY_ACCESS) {
+		Type *array = access_type(children[0]);
+		if (array && array->variableType() == ASTNodeType::ARRAY)
+			return array->getElement();
+	}
+	else if (node->type() == ASTNode::FIELD_ACCESS) {
+		Type *owner = access_type(children[0]);
+		if (owner && owner->variableType() == ASTNodeType::CLASS) {
+			const ClassLayout &layout = owner->getLayout();
+			auto field = layout.fields.find(dynamic_cast<ASTNodeID*>(children[1])->getNameId());
+			if (field != layout.fields.end())
+				return field->second.type;
+		}
+	}
+	else if (node->type() == ASTNode::METHOD_INVOCATION && children[0]->type() == ASTNode::IDENTIFIER) {
+		const Binding &binding = dynamic_cast<ASTNodeID*>(children[0])->getBinding();
+		if (binding.kind == Binding::FUNCTION || binding.kind == Binding::METHOD)
+			return dynamic_cast<ASTNodeType*>(binding.func->getChildren()[3])->getType();
+	}
+	return NULL;
+}
+
+// the type of an expression when it is known without generating it
+static ASTNodeType::VariableType expr_type(ASTNode *node) {
+	if (node->type() == ASTNode::INTEGER)
+		return ASTNodeType::INTEGER;
+	else if (node->type() == ASTNode::BOOLEAN)
+		return ASTNodeType::BOOLEAN;
+	else if (Type *type = access_type(node))
+		return type->variableType();
+	else if (node->type() == ASTNode::BINARY_EXPR) {
+		const string &op = dynamic_cast<ASTNodeBinaryExpr*>(node)->getOp();
+		if (is_logical(op))
+			return ASTNodeType::BOOLEAN;
+		else if (op != ":=")
+			return ASTNodeType::INTEGER;
+	}
+	return ASTNodeType::UNKNOWN;
+}
+
+// whether evaluating node has no effect besides its value
+static bool is_pure(ASTNode *node) {
+	if (node->type() == ASTNode::METHOD_INVOCATION)
+		return false;
+	if (node->type() == ASTNode::BINARY_EXPR &&
+			dynamic_cast<ASTNodeBinaryExpr*>(node)->getOp() == ":=")
+		return false;
+	ChildList children = node->getChildren();
+	for (int i = 0; i < children.size(); ++i)
+		if (!is_pure(children[i]))
+			return false;
+	return true;
+}
+
+// whether two pure expressions always have the same value
+static bool same_expr(ASTNode *a, ASTNode *b) {
+	if (a->type() != b->type())
+		return false;
+	ChildList left = a->getChildren(), right = b->getChildren();
+	if (a->type() == ASTNode::INTEGER || a->type() == ASTNode::BOOLEAN)
+		return dynamic_cast<ASTNodeExpression*>(a)->eval() == dynamic_cast<ASTNodeExpression*>(b)->eval();
+	else if (a->type() == ASTNode::IDENTIFIER)
+		return dynamic_cast<ASTNodeID*>(a)->getNameId() == dynamic_cast<ASTNodeID*>(b)->getNameId();
+	else if (a->type() == ASTNode::THIS)
+		return true;
+	else if (a->type() == ASTNode::FIELD_ACCESS)
+		return same_expr(left[0], right[0]) && dynamic_cast<ASTNodeID*>(left[1])->getNameId() ==
+			dynamic_cast<ASTNodeID*>(right[1])->getNameId();
+	else if (a->type() == ASTNode::ARRAY_ACCESS)
+		return same_expr(left[0], right[0]) && same_expr(left[1], right[1]);
+	else if (a->type() == ASTNode::BINARY_EXPR)
+		return dynamic_cast<ASTNodeBinaryExpr*>(a)->getOp() == dynamic_cast<ASTNodeBinaryExpr*>(b)->getOp() &&
+			same_expr(left[0], right[0]) && same_expr(left[1], right[1]);
+	return false;
+}
+
+static ASTNode* new_literal(const string &op, int value, ASTNode *where) {
+	ASTNode *literal;
+	if (is_logical(op))
+		literal = new ASTNodeBoolean(value != 0);
+	else
+		literal = new ASTNodeInteger(value);
+	literal->setLoc(where->getLoc());
+	return literal;
+}
+
+static ASTNode* new_binary(ASTNode *left, ASTNode *right, const string &op, ASTNode *where) {
+	ASTNode *binary = new ASTNodeBinaryExpr(dynamic_cast<ASTNodeExpression*>(left),
+		dynamic_cast<ASTNodeExpression*>(right), op);
+	binary->setLoc(where->getLoc());
+	return binary;
+}
+
+// combines two constants of an associative chain, unless it overflows
+static bool combine_constant(const string &op, int left, int right, int &value) {
+	long long result;
+	if (op == "+")
+		result = (long long)left + right;
+	else if (op == "*")
+		result = (long long)left * right;
+	else
+		result = fold_binary(op, left, right).second;
+	if (result < INT_MIN || result > INT_MAX)
+		return false;
+	value = result;
+	return true;
+}
+
+// splits node into a part combined by op with a constant, NULL when node is
+// itself a constant, and that constant
+static ASTNode* split_constant(ASTNode *node, const string &op, int &value) {
+	value = algebra_rules.at(op).identity;
+	if (is_literal(node)) {
+		value = dynamic_cast<ASTNodeExpression*>(node)->eval().second;
+		return NULL;
+	}
+	if (node->type() != ASTNode::BINARY_EXPR)
+		return node;
+	const string &node_op = dynamic_cast<ASTNodeBinaryExpr*>(node)->getOp();
+	ChildList children = node->getChildren();
+	if (!is_literal(children[1]))
+		return node;
+	int constant = dynamic_cast<ASTNodeExpression*>(children[1])->eval().second;
+	if (node_op == op)
+		value = constant;
+	else if (op == "+" && node_op == "-" && constant != INT_MIN)
+		value = -constant;
+	else
+		return node;
+	return children[0];
+}
+
+// applies one rule to the i-th child of parent, a binary expression whose
+// operands are simplified, returns whether it was rewritten
+// whether node is known to be of the type the rules for op assume: integer
+// for arithmetic, boolean for 'and' and 'or', either for comparisons; other
+// operands are left for the code generator to report
+static bool typed_operand(const string &op, ASTNode *node) {
+	ASTNodeType::VariableType type = expr_type(node);
+	if (op == "and" || op == "or")
+		return type == ASTNodeType::BOOLEAN;
+	else if (is_logical(op))
+		return type == ASTNodeType::INTEGER || type == ASTNodeType::BOOLEAN;
+	return type == ASTNodeType::INTEGER;
+}
+
+static bool simplify_binary(ASTNode *parent, int i, bool literal) {
+	ASTNode *node = parent->getChildren()[i];
+	if (node->type() != ASTNode::BINARY_EXPR)
+		return false;
+	string op = dynamic_cast<ASTNodeBinaryExpr*>(node)->getOp();
+	if (algebra_rules.find(op) == algebra_rules.end())
+		return false;
+	const AlgebraRule &rule = algebra_rules.at(op);
+	ChildList children = node->getChildren();
+	ASTNode *left = children[0], *right = children[1];
+	bool logic = op == "and" || op == "or";
+	ASTNode *result = NULL;
+
+	if (is_literal(left) && is_literal(right)) {
+		pair<bool, int> value = fold_binary(op, dynamic_cast<ASTNodeExpression*>(left)->eval().second,
+			dynamic_cast<ASTNodeExpression*>(right)->eval().second);
+		if (value.first)
+			result = new_literal(op, value.second, node);
+	}
+	else if (!typed_operand(op, left) || !typed_operand(op, right))
+		return false;
+	else if (logic && is_literal(left)) {
+		// the right operand isn't evaluated when the left one decides
+		bool value = dynamic_cast<ASTNodeExpression*>(left)->eval().second != 0;
+		if (value == bool(rule.zero))
+			result = new_literal(op, value, node);
+		else if (expr_type(right) == ASTNodeType::BOOLEAN)
+			result = right;
+	}
+	else if (is_literal(left) && rule.swapped)
+		result = new_binary(right, left, rule.swapped, node);
+	else if (is_literal(right)) {
+		int value = dynamic_cast<ASTNodeExpression*>(right)->eval().second;
+		if (logic)
+			value = value != 0;
+		ASTNodeType::VariableType type = logic ? ASTNodeType::BOOLEAN : ASTNodeType::INTEGER;
+		if (rule.has_identity && value == rule.identity && expr_type(left) == type)
+			result = left;
+		else if (rule.has_zero && value == rule.zero && is_pure(left))
+			result = new_literal(op, value, node);
+	}
+	else if (rule.self_kind != AlgebraRule::SELF_NONE && is_pure(left) && same_expr(left, right)) {
+		if (rule.self_kind == AlgebraRule::SELF_CONSTANT)
+			result = new_literal(op, rule.self, node);
+		else if (expr_type(left) == (logic ? ASTNodeType::BOOLEAN : ASTNodeType::INTEGER))
+			result = left;
+	}
+
+	if (result == NULL && (rule.associative || op == "-")) {
+		// gather the constants of (x op c1) op (y op c2) into x op y op c
+		string chain = op;
+		if (op == "-") {
+			if (!is_literal(right) || dynamic_cast<ASTNodeExpression*>(right)->eval().second == INT_MIN)
+				return false;
+			chain = "+";
+		}
+		int left_value, right_value, value;
+		ASTNode *left_part = split_constant(left, chain, left_value);
+		ASTNode *right_part = split_constant(right, chain, right_value);
+		if (op == "-")
+			right_value = -right_value;
+		if (left_part == left && (right_part == NULL || right_part == right))
+			return false;
+		if (!combine_constant(chain, left_value, right_value, value))
+			return false;
+		ASTNode *part = left_part;
+		if (right_part)
+			part = new_binary(left_part, right_part, chain, node);
+		if (chain == "+" && value < 0 && value != INT_MIN)
+			result = new_binary(part, new_literal(chain, -value, node), "-", node);
+		else
+			result = new_binary(part, new_literal(chain, value, node), chain, node);
+		if (right_part)
+			while (simplify_binary(result, 0, true));
+	}
+
+	if (result == NULL || (!literal && is_literal(result)))
+		return false;
+	parent->getChildren().replace(i, result);
+	return true;
+}
+
+static void simplify_tree(ASTNode *node);
+
+// simplifies the i-th child of parent, which is replaced by a literal only if
+// literal is set
+static void simplify_expr(ASTNode *parent, int i, bool literal) {
+	ASTNode *node = parent->getChildren()[i];
+	if (node->type() != ASTNode::BINARY_EXPR) {
+		simplify_tree(node);
+		return;
+	}
+	simplify_expr(node, 0, true);
+	simplify_expr(node, 1, true);
+	while (simplify_binary(parent, i, literal));
+}
+
+static void simplify_tree(ASTNode *node) {
+	ChildList children = node->getChildren();
+	if (node->type() == ASTNode::PRINT_STMT) {
+		// literal arguments are merged by collect_info(), so none is added
+		for (int i = 0; i < children[0]->getChildren().size(); ++i)
+			simplify_expr(children[0], i, false);
+		return;
+	}
+	for (int i = 0; i < children.size(); ++i)
+		simplify_expr(node, i, true);
+}
+
+//-------------------------Dead Store Elimination------------------------
+
+// Removes the assignments of a function body whose value is never read: those
+// to a variable that nothing reads, and those to a variable, an element or a
+// field assigned again further in the same block before anything may read
+// it. The right operand stays for its effects, unless it has none and can't
+// fail, and so does the assignment when its type isn't known up front.
+
+static bool is_assign(ASTNode *node) {
+	return node->type() == ASTNode::BINARY_EXPR &&
+		dynamic_cast<ASTNodeBinaryExpr*>(node)->getOp() == ":=";
+}
+
+// the name ids of all the identifiers in node
+static void collect_names(ASTNode *node, set<uint32_t> &names) {
+	ChildList children = node->getChildren();
+	if (node->type() == ASTNode::IDENTIFIER)
+		names.insert(dynamic_cast<ASTNodeID*>(node)->getNameId());
+	for (int i = 0; i < children.size(); ++i)
+		collect_names(children[i], names);
+}
+
+// the name ids of the variables read in node
+static void collect_reads(ASTNode *node, set<uint32_t> &read) {
+	ChildList children = node->getChildren();
+	if (node->type() == ASTNode::IDENTIFIER)
+		read.insert(dynamic_cast<ASTNodeID*>(node)->getNameId());
+	for (int i = 0; i < children.size(); ++i)
+		if (i > 0 || !is_assign(node) || !tracked_id(children[0]))
+			collect_reads(children[i], read);
+}
+
+// whether node mentions a variable of ids
+static bool mentions(ASTNode *node, const set<uint32_t> &ids) {
+	if (node->type() == ASTNode::IDENTIFIER)
+		return ids.find(dynamic_cast<ASTNodeID*>(node)->getNameId()) != ids.end();
+	ChildList children = node->getChildren();
+	for (int i = 0; i < children.size(); ++i)
+		if (mentions(children[i], ids))
+			return true;
+	return false;
+}
+
+// whether evaluating node only reads and writes variables
+static bool is_register_only(ASTNode *node) {
+	if (node->type() == ASTNode::INTEGER || node->type() == ASTNode::BOOLEAN)
+		return true;
+	else if (node->type() == ASTNode::IDENTIFIER)
+		return tracked_id(node) != NULL;
+	else if (node->type() != ASTNode::BINARY_EXPR)
+		return false;
+	ChildList children = node->getChildren();
+	return is_register_only(children[0]) && is_register_only(children[1]);
+}
+
+// whether node has no effect and can't fail, so that it can be left out
+static bool is_harmless(ASTNode *node) {
+	if (node->type() == ASTNode::INTEGER || node->type() == ASTNode::BOOLEAN)
+		return true;
+	else if (node->type() == ASTNode::IDENTIFIER)
+		return tracked_id(node) != NULL;
+	else if (node->type() != ASTNode::BINARY_EXPR)
+		return false;
+	const string &op = dynamic_cast<ASTNodeBinaryExpr*>(node)->getOp();
+	ChildList children = node->getChildren();
+	if (op == ":=" || !is_harmless(children[0]) || !is_harmless(children[1]))
+		return false;
+	if ((op == "/" || op == "%") && (children[1]->type() != ASTNode::INTEGER ||
+			dynamic_cast<ASTNodeInteger*>(children[1])->getValue() == 0))
+		return false;
+	ASTNodeType::VariableType left = expr_type(children[0]), right = expr_type(children[1]);
+	if (op == "and" || op == "or")
+		return left == ASTNodeType::BOOLEAN && right == ASTNodeType::BOOLEAN;
+	else if (op == "==" || op == "!=")
+		return left == right;
+	return left == ASTNodeType::INTEGER && right == ASTNodeType::INTEGER;
+}
+
+// the type of node, a location assigned to, when it is a variable, a field or
+// an element of an array variable or field
+static ASTNodeType::VariableType place_type(ASTNode *node) {
+	if (node->type() == ASTNode::ARRAY_ACCESS) {
+		ChildList children = node->getChildren();
+		if (children[0]->type() != ASTNode::IDENTIFIER || !is_harmless(children[1]))
+			return ASTNodeType::UNKNOWN;
+		const Binding &binding = dynamic_cast<ASTNodeID*>(children[0])->getBinding();
+		if ((binding.kind != Binding::LOCAL && binding.kind != Binding::PARAM &&
+				binding.kind != Binding::FIELD) || binding.type->variableType() != ASTNodeType::ARRAY)
+			return ASTNodeType::UNKNOWN;
+		return binding.type->getElement()->variableType();
+	}
+	return expr_type(node);
+}
+
+// stmt, an 'L := e' statement, without the assignment
+static void drop_store(ASTNode *block, int i) {
+	ASTNode *stmt = block->getChildren()[i];
+	ASTNode *value = stmt->getChildren()[0]->getChildren()[1];
+	if (is_harmless(value)) {
+		ASTNode *empty = new ASTNodeExpressionStmt();
+		empty->setLoc(stmt->getLoc());
+		block->getChildren().replace(i, empty);
+	}
+	else
+		stmt->getChildren().replace(0, value);
+}
+
+// whether the i-th statement of block assigns a location assigned again before
+// it may be read
+static bool is_overwritten(ASTNode *block, int i) {
+	ChildList stmts = block->getChildren();
+	ASTNode *store = stmts[i]->getChildren()[0];
+	ASTNode *place = store->getChildren()[0];
+	ASTNodeType::VariableType type = place_type(place);
+	if ((type != ASTNodeType::INTEGER && type != ASTNodeType::BOOLEAN) || !is_pure(place))
+		return false;
+	type = expr_type(store->getChildren()[1]);
+	if (type != ASTNodeType::INTEGER && type != ASTNodeType::BOOLEAN)
+		return false;
+	bool variable = tracked_id(place) != NULL;
+	set<uint32_t> ids;
+	collect_reads(place, ids);
+	if (variable)
+		ids.insert(dynamic_cast<ASTNodeID*>(place)->getNameId());
+	for (int j = i + 1; j < stmts.size(); ++j) {
+		if (stmts[j]->type() == ASTNode::EMPTY_STMT)
+			continue;
+		else if (stmts[j]->type() != ASTNode::EXPR_STMT)
+			return false;
+		ASTNode *expr = stmts[j]->getChildren()[0];
+		if (is_assign(expr) && same_expr(expr->getChildren()[0], place)) {
+			ASTNode *value = expr->getChildren()[1];
+			return variable ? !mentions(value, ids) : is_register_only(value) && !mentions(value, ids);
+		}
+		// no read of the location, nor change to where it is
+		if (mentions(expr, ids) || (!variable && !is_register_only(expr)))
+			return false;
+	}
+	return false;
+}
+
+static void eliminate_dead_stores(ASTNode *node, const set<uint32_t> &read) {
+	ChildList children = node->getChildren();
+	for (int i = 0; i < children.size(); ++i)
+		eliminate_dead_stores(children[i], read);
+	if (node->type() != ASTNode::BLOCK)
+		return;
+	for (int i = 0; i < children.size(); ++i) {
+		if (children[i]->type() != ASTNode::EXPR_STMT || !is_assign(children[i]->getChildren()[0]))
+			continue;
+		ASTNode *store = children[i]->getChildren()[0];
+		ASTNodeID *id = tracked_id(store->getChildren()[0]);
+		ASTNodeType::VariableType type = expr_type(store->getChildren()[1]);
+		if (id && read.find(id->getNameId()) == read.end() &&
+				(type == ASTNodeType::INTEGER || type == ASTNodeType::BOOLEAN))
+			drop_store(node, i);
+		else if (is_overwritten(node, i))
+			drop_store(node, i);
+	}
+}
+
+static void optimize_body(ASTNode *body) {
+	propagate_constants(body);
+	simplify_tree(body);
+	set<uint32_t> read;
+	collect_reads(body, read);
+	eliminate_dead_stores(body, read);
+}
+
+//-----------------------------------------------------------------------
+
+struct GenCodeInfo {
+	GenCodeInfo(string class_id, Type* ret_type, int count) {
+		this->class_id = class_id;
+		this_type = class_id.empty() ? NULL : Type::get(class_id);
+		this->ret_type = ret_type;
+
+		tempval_count = count;
+		entry_count = 0;
+		arena = false;
+		current_block = 0;
+		in_loop = false;
+		block_isover = false;
+		terminated_bybr = true;
+		packed_lvalue = NULL;
+
+		result_type = NONE;
+		available.block = 0;
+		hoisting = false;
+	}
+
+	enum ResultType {
+		SIMPLE, // ID, THIS, INTEGER, BOOLEAN, STRING
+		VALUE,
+		POINTER,
+		FUNCTION,
+		NONE
+	};
+	string class_id;
+	Type* ret_type;
+	Type* this_type;
+	// the allocas of the parameters by position, -1 for those never named
+	vector<int> param_slot;
+
+	int tempval_count;
+	// allocas for temporaries, placed in the entry block ahead of the body
+	string entry_alloca;
+	int entry_count;
+	bool arena; // %...arena holds the arena mark to restore on return
+	int current_block;
+	bool in_loop;
+	bool block_isover;
+	bool terminated_bybr;
+	vector<int> break_point;
+	vector<int> continue_point;
+	// the left operand of the assignment being generated; an element of a packed
+	// array reached there is a POINTER to its word, with the bit in packed_mask
+	ASTNode* packed_lvalue;
+	string packed_mask;
+	// the registers of the pure instructions of the current block and of those
+	// it was entered from, see gen_pure(), and of the loads from memory since
+	// the last store, see gen_load_memory()
+	struct Available {
+		int block;
+		map<string, int> values;
+		map<string, int> memory;
+	} available;
+	// the registers of the values hoisted out of the loops being generated, valid
+	// anywhere in them, and whether they are being hoisted, see hoist_invariants()
+	map<string, int> invariant;
+	bool hoisting;
+	// the slots of the fields of 'this' promoted in the loops being generated,
+	// by their paths, see promote_fields()
+	map<vector<int>, string> promoted;
+
+	ResultType result_type;
+	struct Result {
+		ASTNodeExpression* expr;
+		struct {
+			int index; // %1
+			string id; // %local, when index = -1
+			Type* type;
+			bool islvalue;
+		} regval;
+		struct {
+			string class_id;
+			int this_index; // %1
+			string this_id; // %local, when this_index = -1
+			ASTNodeFunctionDefn* func;
+		} func;
+	} result;
+	Location loc;
+};
+
+// Output goes through a buffer flushed when full and at exit, so a print
+// statement doesn't cost a stdio call per value. The runtime is emitted into
+// every module which prints or uses the arena, so the output still runs with
+// a plain 'lli'.
+static void gen_runtime() {
+	cout << "@dragon.buf = internal global [65536 x i8] zeroinitializer, align 16" << endl;
+	cout << "@dragon.len = internal global i32 0, align 4" << endl;
+	cout << "@dragon.arena.top = internal global i8* null, align 8" << endl;
+	cout << "@dragon.arena.end = internal global i8* null, align 8" << endl;
+	// "00" "01" ... "99", so that itoa emits two digits per division
+	cout << "@dragon.digits = private unnamed_addr constant [200 x i8] c\"";
+	for (int i = 0; i < 100; ++i)
+		cout << i / 10 << i % 10;
+	cout << "\", align 1" << endl;
+	cout << "@dragon.punct = private unnamed_addr constant [7 x i8] c\"[]{}, \\00\", align 1" << endl;
+	cout << endl;
+	cout << R"(define internal void @dragon_write(i8* %s, i64 %n) #1 {
+entry:
+  br label %loop
+
+loop:
+  %p = phi i8* [ %s, %entry ], [ %p.next, %more ]
+  %left = phi i64 [ %n, %entry ], [ %left.next, %more ]
+  %done = icmp sle i64 %left, 0
+  br i1 %done, label %exit, label %write
+
+write:
+  %written = call i64 @write(i32 1, i8* %p, i64 %left)
+  %failed = icmp sle i64 %written, 0
+  br i1 %failed, label %exit, label %more
+
+more:
+  %p.next = getelementptr inbounds i8* %p, i64 %written
+  %left.next = sub i64 %left, %written
+  br label %loop
+
+exit:
+  ret void
+}
+
+define internal void @dragon_flush() #1 {
+entry:
+  %len = load i32* @dragon.len, align 4
+  %n = sext i32 %len to i64
+  call void @dragon_write(i8* getelementptr inbounds ([65536 x i8]* @dragon.buf, i64 0, i64 0), i64 %n)
+  store i32 0, i32* @dragon.len, align 4
+  ret void
+}
+
+define internal void @dragon_print_str(i8* %s, i32 %n) #1 {
+entry:
+  %len = load i32* @dragon.len, align 4
+  %end = add i32 %len, %n
+  %full = icmp ugt i32 %end, 65536
+  br i1 %full, label %flush, label %copy
+
+flush:
+  call void @dragon_flush()
+  %big = icmp ugt i32 %n, 65536
+  br i1 %big, label %direct, label %copy
+
+direct:
+  %size.direct = zext i32 %n to i64
+  call void @dragon_write(i8* %s, i64 %size.direct)
+  ret void
+
+copy:
+  %pos = phi i32 [ %len, %entry ], [ 0, %flush ]
+  %pos.ext = zext i32 %pos to i64
+  %dst = getelementptr inbounds [65536 x i8]* @dragon.buf, i64 0, i64 %pos.ext
+  %size = zext i32 %n to i64
+  %copied = call i8* @memcpy(i8* %dst, i8* %s, i64 %size)
+  %len.new = add i32 %pos, %n
+  store i32 %len.new, i32* @dragon.len, align 4
+  ret void
+}
+
+define internal void @dragon_print_i32(i32 %v) #1 {
+entry:
+  %buf = alloca [12 x i8], align 1
+  %neg = icmp slt i32 %v, 0
+  %v.neg = sub i32 0, %v
+  %u = select i1 %neg, i32 %v.neg, i32 %v
+  br label %pairs
+
+pairs:
+  %x = phi i32 [ %u, %entry ], [ %q, %pair ]
+  %pos = phi i32 [ 12, %entry ], [ %pos.pair, %pair ]
+  %ge100 = icmp uge i32 %x, 100
+  br i1 %ge100, label %pair, label %tail
+
+pair:
+  %q = udiv i32 %x, 100
+  %q100 = mul i32 %q, 100
+  %r = sub i32 %x, %q100
+  %r2 = shl i32 %r, 1
+  %src = getelementptr inbounds [200 x i8]* @dragon.digits, i32 0, i32 %r2
+  %src16 = bitcast i8* %src to i16*
+  %d = load i16* %src16, align 1
+  %pos.pair = sub i32 %pos, 2
+  %dst = getelementptr inbounds [12 x i8]* %buf, i32 0, i32 %pos.pair
+  %dst16 = bitcast i8* %dst to i16*
+  store i16 %d, i16* %dst16, align 1
+  br label %pairs
+
+tail:
+  %ge10 = icmp uge i32 %x, 10
+  br i1 %ge10, label %two, label %one
+
+two:
+  %x2 = shl i32 %x, 1
+  %src.two = getelementptr inbounds [200 x i8]* @dragon.digits, i32 0, i32 %x2
+  %src16.two = bitcast i8* %src.two to i16*
+  %d.two = load i16* %src16.two, align 1
+  %pos.two = sub i32 %pos, 2
+  %dst.two = getelementptr inbounds [12 x i8]* %buf, i32 0, i32 %pos.two
+  %dst16.two = bitcast i8* %dst.two to i16*
+  store i16 %d.two, i16* %dst16.two, align 1
+  br label %sign
+
+one:
+  %x8 = trunc i32 %x to i8
+  %c = add i8 %x8, 48
+  %pos.one = sub i32 %pos, 1
+  %dst.one = getelementptr inbounds [12 x i8]* %buf, i32 0, i32 %pos.one
+  store i8 %c, i8* %dst.one, align 1
+  br label %sign
+
+sign:
+  %start = phi i32 [ %pos.two, %two ], [ %pos.one, %one ]
+  br i1 %neg, label %minus, label %out
+
+minus:
+  %start.minus = sub i32 %start, 1
+  %dst.minus = getelementptr inbounds [12 x i8]* %buf, i32 0, i32 %start.minus
+  store i8 45, i8* %dst.minus, align 1
+  br label %out
+
+out:
+  %begin = phi i32 [ %start, %sign ], [ %start.minus, %minus ]
+  %p = getelementptr inbounds [12 x i8]* %buf, i32 0, i32 %begin
+  %n = sub i32 12, %begin
+  call void @dragon_print_str(i8* %p, i32 %n)
+  ret void
+}
+
+define internal void @dragon_print_bool(i1 %b) #1 {
+entry:
+  ; the '0' and '1' of "00" and "01"
+  %i = select i1 %b, i32 3, i32 1
+  %p = getelementptr inbounds [200 x i8]* @dragon.digits, i32 0, i32 %i
+  call void @dragon_print_str(i8* %p, i32 1)
+  ret void
+}
+
+; large locals of functions other than main() are bump allocated from an
+; arena reserved on first use, and released by restoring the mark on return
+define internal i8* @dragon_arena_mark() #1 {
+entry:
+  %top = load i8** @dragon.arena.top, align 8
+  %empty = icmp eq i8* %top, null
+  br i1 %empty, label %reserve, label %exit
+
+reserve:
+  ; PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE
+  %base = call i8* @mmap(i8* null, i64 4294967296, i32 3, i32 16418, i32 -1, i64 0)
+  %failed = icmp eq i8* %base, inttoptr (i64 -1 to i8*)
+  br i1 %failed, label %abort, label %init
+
+init:
+  %end = getelementptr inbounds i8* %base, i64 4294967296
+  store i8* %base, i8** @dragon.arena.top, align 8
+  store i8* %end, i8** @dragon.arena.end, align 8
+  br label %exit
+
+abort:
+  call void @dragon_flush()
+  call void @abort() noreturn
+  unreachable
+
+exit:
+  %mark = phi i8* [ %top, %entry ], [ %base, %init ]
+  ret i8* %mark
+}
+
+define internal i8* @dragon_arena_alloc(i64 %size) #1 {
+entry:
+  %top = load i8** @dragon.arena.top, align 8
+  %size.up = add i64 %size, 15
+  %size.aligned = and i64 %size.up, -16
+  %next = getelementptr inbounds i8* %top, i64 %size.aligned
+  %end = load i8** @dragon.arena.end, align 8
+  %over = icmp ugt i8* %next, %end
+  br i1 %over, label %abort, label %ok
+
+abort:
+  call void @dragon_flush()
+  call void @abort() noreturn
+  unreachable
+
+ok:
+  store i8* %next, i8** @dragon.arena.top, align 8
+  ret i8* %top
+}
+
+declare i64 @write(i32, i8*, i64) #0
+declare i8* @memcpy(i8*, i8*, i64) #0
+declare i8* @mmap(i8*, i64, i32, i32, i32, i64) #0
+declare void @abort() #0
+
+@llvm.global_dtors = appending global [1 x { i32, void ()*, i8* }] [{ i32, void ()*, i8* } { i32 65535, void ()* @dragon_flush, i8* null }])" << endl;
+}
+
+// %<index>, or %<id> when index = -1, points to the array or class
+static string gen_print_aggregate(Type *type, int index, const string &id) {
+	stringstream result;
+	if (print_table.insert(type).second)
+		print_queue.push_back(type);
+	result << "  call void @dragon.print." << type->getValue() << "(" << type->getAsm() << "* %";
+	if (index >= 0)
+		result << index;
+	else
+		result << id;
+	result << ")" << endl;
+	return result.str();
+}
+
+static void gen_print_punct(int offset, int length) {
+	cout << "  call void @dragon_print_str(i8* getelementptr inbounds ([7 x i8]* @dragon.punct, "
+		<< "i32 0, i32 " << offset << "), i32 " << length << ")" << endl;
+}
+
+// print the value of the given type stored at %<ptr>
+static void gen_print_element(Type *type, const string &ptr) {
+	if (type->variableType() == ASTNodeType::INTEGER) {
+		cout << "  %" << ptr << ".v = load i32* %" << ptr << ", align 4" << endl;
+		cout << "  call void @dragon_print_i32(i32 %" << ptr << ".v)" << endl;
+	}
+	else if (type->variableType() == ASTNodeType::BOOLEAN) {
+		cout << "  %" << ptr << ".v = load i8* %" << ptr << ", align 1" << endl;
+		cout << "  %" << ptr << ".b = trunc i8 %" << ptr << ".v to i1" << endl;
+		cout << "  call void @dragon_print_bool(i1 %" << ptr << ".b)" << endl;
+	}
+	else
+		cout << gen_print_aggregate(type, -1, ptr);
+}
+
+// An array is printed as [e0, e1, ...] and a class as {f0, f1, ...} with the
+// fields in declaration order, everything through the output buffer.
+static void gen_printers() {
+	for (int i = 0; i < print_queue.size(); ++i) {
+		Type *type = print_queue[i];
+		cout << "define internal void @dragon.print." << type->getValue() << "("
+			<< type->getAsm() << "* %p) #1 {" << endl;
+		cout << "entry:" << endl;
+		if (type->variableType() == ASTNodeType::ARRAY) {
+			gen_print_punct(0, 1);
+			cout << "  br label %loop" << endl << endl;
+			cout << "loop:" << endl;
+			cout << "  %i = phi i32 [ 0, %entry ], [ %next, %elem ]" << endl;
+			cout << "  %first = icmp eq i32 %i, 0" << endl;
+			cout << "  br i1 %first, label %elem, label %sep" << endl << endl;
+			cout << "sep:" << endl;
+			gen_print_punct(4, 2);
+			cout << "  br label %elem" << endl << endl;
+			cout << "elem:" << endl;
+			if (type->isPacked()) {
+				cout << "  %word = lshr i32 %i, 5" << endl;
+				cout << "  %bit = and i32 %i, 31" << endl;
+				cout << "  %mask = shl i32 1, %bit" << endl;
+				cout << "  %w = getelementptr inbounds " << type->getAsm() << "* %p, i32 0, i32 %word" << endl;
+				cout << "  %w.v = load i32* %w, align 4" << endl;
+				cout << "  %e.bit = and i32 %w.v, %mask" << endl;
+				cout << "  %e.set = icmp ne i32 %e.bit, 0" << endl;
+				cout << "  call void @dragon_print_bool(i1 %e.set)" << endl;
+			}
+			else {
+				cout << "  %e = getelementptr inbounds " << type->getAsm() << "* %p, i32 0, i32 %i" << endl;
+				gen_print_element(type->getElement(), "e");
+			}
+			cout << "  %next = add i32 %i, 1" << endl;
+			cout << "  %done = icmp eq i32 %next, " << type->getLength() << endl;
+			cout << "  br i1 %done, label %exit, label %loop" << endl << endl;
+			cout << "exit:" << endl;
+			gen_print_punct(1, 1);
+		}
+		else {
+			const ClassLayout &layout = type->getLayout();
+			vector<const ClassLayout::Field*> fields;
+			for (auto &field : layout.fields)
+				fields.push_back(&field.second);
+			// in declaration order, starting from the base class
+			sort(fields.begin(), fields.end(), [](const ClassLayout::Field *a, const ClassLayout::Field *b) {
+				return a->depth != b->depth ? a->depth > b->depth : a->index < b->index;
+			});
+			gen_print_punct(2, 1);
+			for (int j = 0; j < fields.size(); ++j) {
+				if (j != 0)
+					gen_print_punct(4, 2);
+				cout << "  %f" << j << " = getelementptr inbounds " << type->getAsm() << "* %p, i32 0";
+				for (int k : fields[j]->path)
+					cout << ", i32 " << k;
+				cout << endl;
+				stringstream field;
+				field << "f" << j;
+				gen_print_element(fields[j]->type, field.str());
+			}
+			gen_print_punct(3, 1);
+		}
+		cout << "  ret void" << endl;
+		cout << "}" << endl << endl;
+	}
+}
+
+//--------------------------------Inlining---------------------------------
+
+// Calls are inlined on the emitted IR, bottom-up over the call graph, so that
+// a callee has its own calls inlined first. A callee is inlined when it is
+// small, or called from few places, and never part of a cycle of calls. Its
+// values and labels are renamed apart, its arguments replaced by the operands
+// of the call and its allocas moved to the entry of the caller, while its
+// returns branch to a block merging the values returned.
+
+struct IRFunction {
+	string head; // the define line
+	vector<string> params; // names of the arguments, by position
+	vector<string> body; // the lines between the braces
+	set<string> callees;
+	int size; // instructions
+	bool inlinable;
+};
+
+// splits "a, b, c" where the commas are not nested in brackets
+static vector<string> split_operands(const string &list) {
+	vector<string> operands;
+	int depth = 0, begin = 0;
+	for (int i = 0; i < list.size(); ++i) {
+		if (list[i] == '(' || list[i] == '[' || list[i] == '{')
+			++depth;
+		else if (list[i] == ')' || list[i] == ']' || list[i] == '}')
+			--depth;
+		else if (list[i] == ',' && depth == 0) {
+			operands.push_back(list.substr(begin, i - begin));
+			begin = i + 2;
+		}
+	}
+	if (begin < list.size())
+		operands.push_back(list.substr(begin));
+	return operands;
+}
+
+// the value of "type value", or the name of "type %name"
+static string last_token(const string &operand) {
+	return operand.substr(operand.rfind(' ') + 1);
+}
+
+static bool is_name_char(char c) {
+	return isalnum(c) || c == '.' || c == '_' || c == '$' || c == '-';
+}
+
+// the function called by line and the operands passed, if it is a call
+static bool parse_call(const string &line, string &callee, vector<string> &args) {
+	if (line.compare(0, 2, "  ") != 0)
+		return false;
+	size_t call = line.compare(0, 3, "  %") == 0 ? line.find(" = ") + 3 : 2;
+	if (call > line.size())
+		return false;
+	if (line.compare(call, 5, "tail ") == 0)
+		call += 5;
+	if (line.compare(call, 5, "call ") != 0)
+		return false;
+	size_t at = line.find(" @", call);
+	size_t open = line.find('(', at);
+	if (at == string::npos || open == string::npos)
+		return false;
+	callee = line.substr(at + 2, open - at - 2);
+	args = split_operands(line.substr(open + 1, line.rfind(')') - open - 1));
+	return true;
+}
+
+static bool is_label(const string &line) {
+	return line.compare(0, 10, "; <label>:") == 0 ||
+		(!line.empty() && line[0] != ' ' && line.back() == ':');
+}
+
+// the name of the block starting at line, a label
+static string label_name(const string &line) {
+	if (line[0] != ';')
+		return line.substr(0, line.size() - 1);
+	size_t end = 10;
+	while (end < line.size() && isdigit(line[end]))
+		++end;
+	return line.substr(10, end - 10);
+}
+static bool is_terminator(const string &line) {
+	return line.compare(0, 5, "  br ") == 0 || line.compare(0, 6, "  ret ") == 0 ||
+		line == "  unreachable" || line == "  ]";
+}
+// a block no branch reaches, following a terminator, has no label but still
+// takes the next number; writes out its label so no pass misses it
+static void label_blocks(vector<string> &body) {
+	vector<string> result;
+	int next = 1;
+	bool ended = false;
+	for (const string &line : body) {
+		if (is_label(line)) {
+			string name = label_name(line);
+			if (isdigit(name[0]))
+				next = atoi(name.c_str()) + 1;
+			ended = false;
+		}
+		else if (!line.empty()) {
+			if (ended) {
+				stringstream ss;
+				ss << "; <label>:" << next++;
+				result.push_back("");
+				result.push_back(ss.str());
+			}
+			if (line.compare(0, 3, "  %") == 0 && isdigit(line[3]) && line.find(" = ") != string::npos)
+				next = atoi(line.c_str() + 3) + 1;
+			ended = is_terminator(line);
+		}
+		result.push_back(line);
+	}
+	body = result;
+}
+
+// line of the callee with its names prefixed, but its arguments replaced
+static string rename_values(const string &line, const string &prefix, const map<string, string> &args) {
+	string result;
+	for (int i = 0; i < line.size(); ++i) {
+		if (line[i] != '%') {
+			result += line[i];
+			continue;
+		}
+		int end = i + 1;
+		while (end < line.size() && is_name_char(line[end]))
+			++end;
+		string name = line.substr(i + 1, end - i - 1);
+		if (name.compare(0, 6, "class.") == 0)
+			result += "%" + name;
+		else if (args.find(name) != args.end())
+			result += args.at(name);
+		else
+			result += "%" + prefix + name;
+		i = end - 1;
+	}
+	return result;
+}
+
+static int count_instructions(const vector<string> &body) {
+	int size = 0;
+	for (const string &line : body)
+		if (line.compare(0, 2, "  ") == 0 && line.find(" = alloca ") == string::npos)
+			++size;
+	return size;
+}
+
+// whether callee may be inlined into caller at a call from one of sites
+static bool should_inline(const IRFunction &caller, const IRFunction &callee, int sites) {
+	if (!callee.inlinable || caller.size + callee.size > INLINE_CALLER_SIZE)
+		return false;
+	return callee.size <= INLINE_SIZE || callee.size * sites <= INLINE_GROWTH;
+}
+
+static void inline_calls(IRFunction &caller, map<string, IRFunction> &functions, const map<string, int> &sites) {
+	vector<string> body, allocas;
+	// the blocks split by an inlined call, to the block ending them
+	map<string, string> moved;
+	string block = "0";
+	for (const string &line : caller.body) {
+		string name;
+		vector<string> args;
+		if (is_label(line))
+			block = label_name(line);
+		if (!parse_call(line, name, args) || functions.find(name) == functions.end() ||
+				!should_inline(caller, functions[name], sites.at(name))) {
+			body.push_back(line);
+			continue;
+		}
+		const IRFunction &callee = functions[name];
+		stringstream ss;
+		ss << "i" << inline_count++ << ".";
+		string prefix = ss.str();
+		map<string, string> operands;
+		for (int i = 0; i < callee.params.size(); ++i)
+			operands[callee.params[i]] = last_token(args[i]);
+
+		body.push_back("  br label %" + prefix + "0");
+		body.push_back(prefix + "0:");
+		string callee_block = prefix + "0";
+		vector<pair<string, string>> returns;
+		for (const string &callee_line : callee.body) {
+			if (is_label(callee_line)) {
+				callee_block = prefix + label_name(callee_line);
+				body.push_back(callee_block + ":");
+			}
+			else if (callee_line.find(" = alloca ") != string::npos)
+				allocas.push_back(rename_values(callee_line, prefix, operands));
+			else if (callee_line.compare(0, 6, "  ret ") == 0) {
+				string value = rename_values(callee_line, prefix, operands);
+				if (callee_line != "  ret void")
+					returns.push_back(make_pair(last_token(value), callee_block));
+				body.push_back("  br label %" + prefix + "exit");
+			}
+			else {
+				// the arguments of a tail call may now point into the frame of the caller
+				body.push_back(rename_values(callee_line, prefix, operands));
+				size_t tail = body.back().find("tail call ");
+				string tail_callee;
+				vector<string> tail_args;
+				if (tail != string::npos && parse_call(callee_line, tail_callee, tail_args))
+					body.back().erase(tail, 5);
+			}
+		}
+		body.push_back("");
+		body.push_back(prefix + "exit:");
+		size_t assign = line.find(" = ");
+		if (line.compare(0, 3, "  %") == 0 && assign < line.find("call ")) {
+			size_t type = line.find("call ") + 5;
+			stringstream phi;
+			phi << line.substr(0, assign) << " = phi " << line.substr(type, line.find(" @", type) - type);
+			for (int i = 0; i < returns.size(); ++i)
+				phi << (i ? "," : "") << " [ " << returns[i].first << ", %" << returns[i].second << " ]";
+			body.push_back(phi.str());
+		}
+		moved[block] = prefix + "exit";
+		block = prefix + "exit";
+		caller.size += callee.size;
+	}
+
+	// the phis of the caller now come from the blocks ending the split ones
+	for (string &line : body) {
+		if (line.find(" = phi ") == string::npos || moved.empty())
+			continue;
+		for (size_t i = line.find(", %"); i != string::npos; i = line.find(", %", i + 1)) {
+			size_t end = line.find(" ]", i);
+			string label = line.substr(i + 3, end - i - 3);
+			if (moved.find(label) == moved.end())
+				continue;
+			while (moved.find(label) != moved.end())
+				label = moved[label];
+			line.replace(i + 3, end - i - 3, label);
+		}
+	}
+	// at the end of the entry block
+	auto end = body.begin();
+	while (end != body.end() && !is_terminator(*end) && end->compare(0, 9, "  switch ") != 0)
+		++end;
+	body.insert(end, allocas.begin(), allocas.end());
+	caller.body = body;
+}
+
+// Calls followed by a return of their value are tail calls. One of the
+// function itself becomes a branch back to its start, where the arguments
+// are phis of those passed, and another is marked 'tail', as long as no
+// operand may point into the frame of the caller: a pointer operand must be
+// an argument, as passed or as reloaded from its slot.
+static void eliminate_tail_calls(IRFunction &func, const string &name) {
+	vector<string> &body = func.body;
+	set<string> params(func.params.begin(), func.params.end());
+	// the definitions of the values, and the argument held by each slot only
+	// stored to by the prologue
+	map<string, string> defs, slots;
+	map<string, int> stores;
+	for (const string &line : body) {
+		size_t assign = line.find(" = ");
+		if (line.compare(0, 3, "  %") == 0 && assign != string::npos)
+			defs[line.substr(3, assign - 3)] = line.substr(assign + 3);
+		if (line.compare(0, 8, "  store ") != 0)
+			continue;
+		vector<string> operands = split_operands(line.substr(8));
+		string slot = last_token(operands[1]).substr(1);
+		++stores[slot];
+		string value = last_token(operands[0]);
+		if (value[0] == '%' && params.find(value.substr(1)) != params.end())
+			slots[slot] = value.substr(1);
+	}
+	auto frame_free = [&](const string &operand) {
+		if (operand.find('*') == string::npos)
+			return true;
+		string value = last_token(operand);
+		if (value[0] != '%')
+			return false;
+		value = value.substr(1);
+		if (params.find(value) != params.end())
+			return true;
+		auto def = defs.find(value);
+		if (def == defs.end())
+			return false;
+		vector<string> operands = split_operands(def->second);
+		if (def->second.compare(0, 5, "load ") == 0) {
+			string slot = last_token(operands[0]).substr(1);
+			return slots.find(slot) != slots.end() && stores[slot] == 1;
+		}
+		if (def->second.compare(0, 23, "getelementptr inbounds ") == 0 && operands.size() == 2 &&
+				operands[1] == "i64 0")
+			return params.find(last_token(operands[0]).substr(1)) != params.end();
+		return false;
+	};
+
+	// the self calls in tail position, by line
+	map<int, vector<string>> self_calls;
+	bool entry_allocas = func.head.find(" sret ") == string::npos, prologue = true;
+	for (int i = 0; i < body.size(); ++i) {
+		if (body[i].find(" = alloca ") != string::npos)
+			entry_allocas = entry_allocas && prologue;
+		else if (body[i].compare(0, 3, "  %") == 0 && isdigit(body[i][3]))
+			prologue = false;
+		else if (is_label(body[i]))
+			prologue = false;
+		string callee;
+		vector<string> args;
+		if (i + 1 == body.size() || !parse_call(body[i], callee, args))
+			continue;
+		size_t assign = body[i].find(" = ");
+		string ret = "  ret void";
+		if (body[i].compare(0, 3, "  %") == 0) {
+			size_t type = body[i].find("call ") + 5;
+			ret = "  ret " + body[i].substr(type, body[i].find(" @", type) - type) + " " +
+				body[i].substr(2, assign - 2);
+		}
+		else if (func.head.compare(0, 12, "define void ") != 0)
+			continue;
+		if (body[i + 1] != ret || !all_of(args.begin(), args.end(), frame_free))
+			continue;
+		if (callee == name)
+			self_calls[i] = args;
+		else if (body[i].find("tail call ") == string::npos)
+			body[i].replace(body[i].find("call "), 5, "tail call ");
+	}
+	if (self_calls.empty() || !entry_allocas)
+		return;
+
+	// the allocas stay in the entry block, the rest loops back to tr.0 and is
+	// renamed, as the values of the dropped calls leave gaps in the numbering
+	map<string, string> renamed;
+	for (const string &param : func.params)
+		renamed[param] = "%" + param + ".tr";
+	vector<string> loop, allocas;
+	vector<pair<string, vector<string>>> edges;
+	string block = "tr.0";
+	for (int i = 0; i < body.size(); ++i) {
+		if (body[i].find(" = alloca ") != string::npos)
+			allocas.push_back(rename_values(body[i], "tr.", renamed));
+		else if (is_label(body[i])) {
+			block = "tr." + label_name(body[i]);
+			loop.push_back(block + ":");
+		}
+		else if (self_calls.find(i) == self_calls.end())
+			loop.push_back(rename_values(body[i], "tr.", renamed));
+		else {
+			vector<string> values;
+			for (const string &arg : self_calls[i])
+				values.push_back(rename_values(last_token(arg), "tr.", renamed));
+			edges.push_back(make_pair(block, values));
+			loop.push_back("  br label %tr.0");
+			++i;
+		}
 	}
+	allocas.push_back("  br label %tr.0");
+	allocas.push_back("");
+	allocas.push_back("tr.0:");
+	size_t open = func.head.find('(');
+	vector<string> types = split_operands(func.head.substr(open + 1, func.head.rfind(')') - open - 1));
+	for (int i = 0; i < func.params.size(); ++i) {
+		string type = types[i].substr(0, types[i].rfind(' '));
+		stringstream phi;
+		phi << "  %" << func.params[i] << ".tr = phi " << type << " [ %" << func.params[i] << ", %0 ]";
+		for (auto &edge : edges)
+			phi << ", [ " << edge.second[i] << ", %" << edge.first << " ]";
+		allocas.push_back(phi.str());
+	}
+	allocas.insert(allocas.end(), loop.begin(), loop.end());
+	body = allocas;
+}
 
-	func_table[id] = this;
-	children[5]->collect_info();
+static bool is_constant(const string &operand) {
+	if (operand.find('*') != string::npos)
+		return false;
+	string value = last_token(operand);
+	return isdigit(value[0]) || (value[0] == '-' && value.size() > 1) || value == "true" || value == "false";
 }
 
-//-----------------------------------------------------------------------
+// whether line uses or defines the value %name
+static bool mentions_value(const string &line, const string &name) {
+	for (size_t i = line.find('%'); i != string::npos; i = line.find('%', i + 1)) {
+		size_t end = i + 1;
+		while (end < line.size() && is_name_char(line[end]))
+			++end;
+		if (line.compare(i + 1, end - i - 1, name) == 0 && end - i - 1 == name.size())
+			return true;
+	}
+	return false;
+}
 
-struct GenCodeInfo {
-	GenCodeInfo(string class_id, map<string, ASTNodeFunctionDefn*>* func_table,
-			map<string, pair<int, ASTNodeType*>>* var_table,
-			map<string, pair<int, ASTNodeType*>>* params,
-			map<string, ASTNodeType*>* localvar_table,
-			ASTNodeType* ret_type, int count) {
-		this->class_id = class_id;
-		this->func_table = func_table;
-		this->var_table = var_table;
-		this->params = params;
-		this->localvar_table = localvar_table;
-		this->ret_type = ret_type;
+// replaces the values of body by renamed, numbering the remaining unnamed
+// ones again from the entry block on
+static void renumber_values(vector<string> &body, map<string, string> renamed) {
+	int next = 1;
+	for (const string &line : body) {
+		size_t assign = line.find(" = ");
+		string name;
+		if (line.compare(0, 10, "; <label>:") == 0)
+			name = label_name(line);
+		else if (line.compare(0, 3, "  %") == 0 && assign != string::npos)
+			name = line.substr(3, assign - 3);
+		if (!name.empty() && isdigit(name[0]) && renamed.find(name) == renamed.end()) {
+			stringstream ss;
+			ss << "%" << next++;
+			renamed[name] = ss.str();
+		}
+	}
+	for (string &line : body) {
+		if (line.compare(0, 10, "; <label>:") != 0) {
+			line = rename_values(line, "", renamed);
+			continue;
+		}
+		// the comment stays in its column
+		string name = label_name(line), number = renamed[name].substr(1);
+		string rest = rename_values(line.substr(10 + name.size()), "", renamed);
+		size_t spaces = rest.find_first_not_of(' ');
+		if (spaces != string::npos && spaces > 0)
+			rest = string(max<int>(1, spaces + name.size() - number.size()), ' ') + rest.substr(spaces);
+		line = "; <label>:" + number + rest;
+	}
+}
 
-		tempval_count = count;
-		current_block = 0;
-		in_loop = false;
-		block_isover = false;
-		terminated_bybr = true;
+// a copy of func without the arguments given a constant in args, loads of
+// their slots being replaced by the constant
+static IRFunction specialize(const IRFunction &func, const string &name, const vector<string> &args) {
+	IRFunction clone = IRFunction();
+	size_t open = func.head.find('('), at = func.head.find('@');
+	vector<string> types = split_operands(func.head.substr(open + 1, func.head.rfind(')') - open - 1));
+	map<string, string> renamed;
+	string kept;
+	for (int i = 0; i < func.params.size(); ++i) {
+		if (!args[i].empty()) {
+			renamed[func.params[i]] = args[i];
+			continue;
+		}
+		kept += (kept.empty() ? "" : ", ") + types[i];
+		clone.params.push_back(func.params[i]);
+	}
+	clone.head = func.head.substr(0, at + 1) + name + "(" + kept + func.head.substr(func.head.rfind(')'));
 
-		result_type = NONE;
+	// booleans are widened before being stored
+	set<string> widened;
+	for (const string &line : func.body) {
+		size_t zext = line.find(" = zext i1 %");
+		if (line.compare(0, 3, "  %") != 0 || zext == string::npos)
+			continue;
+		string value = line.substr(zext + 12, line.find(' ', zext + 12) - zext - 12);
+		if (renamed.find(value) == renamed.end())
+			continue;
+		widened.insert(line.substr(3, zext - 3));
+		renamed[line.substr(3, zext - 3)] = renamed[value] == "true" ? "1" : "0";
 	}
 
-	enum ResultType {
-		SIMPLE, // ID, THIS, INTEGER, BOOLEAN, STRING
-		VALUE,
-		POINTER,
-		FUNCTION,
-		NONE
-	};
-	string class_id;
-	map<string, ASTNodeFunctionDefn*>* func_table;
-	map<string, pair<int, ASTNodeType*>>* var_table;
-	map<string, pair<int, ASTNodeType*>>* params;
-	map<string, ASTNodeType*>* localvar_table;
-	ASTNodeType* ret_type;
+	// the slots only written by the prologue with a constant, and only loaded
+	set<string> slots;
+	for (const string &line : func.body) {
+		if (line.compare(0, 8, "  store ") != 0)
+			continue;
+		vector<string> operands = split_operands(line.substr(8));
+		string value = last_token(operands[0]).substr(1);
+		if (renamed.find(value) != renamed.end())
+			slots.insert(last_token(operands[1]).substr(1));
+	}
+	for (auto slot = slots.begin(); slot != slots.end();) {
+		int stores = 0;
+		bool only_loaded = true;
+		for (const string &line : func.body) {
+			if (!mentions_value(line, *slot) || line.find(" = alloca ") != string::npos)
+				continue;
+			if (line.compare(0, 8, "  store ") == 0 && !mentions_value(split_operands(line.substr(8))[0], *slot))
+				++stores;
+			else if (line.find(" = load ") == string::npos)
+				only_loaded = false;
+		}
+		if (stores == 1 && only_loaded)
+			++slot;
+		else
+			slot = slots.erase(slot);
+	}
+	for (const string &line : func.body) {
+		size_t assign = line.find(" = ");
+		if (line.compare(0, 3, "  %") == 0 && assign != string::npos &&
+				(slots.find(line.substr(3, assign - 3)) != slots.end() ||
+				widened.find(line.substr(3, assign - 3)) != widened.end()))
+			continue;
+		bool dropped = false;
+		for (const string &slot : slots) {
+			if (!mentions_value(line, slot))
+				continue;
+			dropped = true;
+			if (line.compare(0, 8, "  store ") == 0)
+				renamed[slot] = last_token(split_operands(line.substr(8))[0]);
+		}
+		if (!dropped)
+			clone.body.push_back(line);
+	}
+	for (const string &line : func.body) {
+		size_t assign = line.find(" = load ");
+		if (line.compare(0, 3, "  %") != 0 || assign == string::npos)
+			continue;
+		string slot = last_token(split_operands(line.substr(assign + 8))[0]).substr(1);
+		if (slots.find(slot) != slots.end())
+			renamed[line.substr(3, assign - 3)] = rename_values(renamed[slot], "", renamed);
+	}
+	for (const string &slot : slots)
+		renamed.erase(slot);
+	renumber_values(clone.body, renamed);
+	return clone;
+}
 
-	int tempval_count;
-	int current_block;
-	bool in_loop;
-	bool block_isover;
-	bool terminated_bybr;
-	vector<int> break_point;
-	vector<int> continue_point;
+// clones the functions for the constant arguments they are most often
+// called with, within the growth, and redirects the matching calls
+static void specialize_functions(map<string, IRFunction> &functions, vector<pair<string, bool>> &lines) {
+	// the calls by callee and constant arguments, "" where not constant
+	map<pair<string, vector<string>>, int> calls;
+	for (auto &i : functions)
+		for (const string &line : i.second.body) {
+			string callee;
+			vector<string> args;
+			if (!parse_call(line, callee, args) || callee == "main" || functions.find(callee) == functions.end())
+				continue;
+			bool constant = false;
+			for (string &arg : args) {
+				arg = is_constant(arg) ? last_token(arg) : "";
+				constant = constant || !arg.empty();
+			}
+			if (constant)
+				++calls[make_pair(callee, args)];
+		}
+	vector<pair<int, pair<string, vector<string>>>> order;
+	for (auto &i : calls)
+		order.push_back(make_pair(-i.second, i.first));
+	sort(order.begin(), order.end());
+
+	map<pair<string, vector<string>>, string> clones;
+	set<string> specialized;
+	int growth = 0;
+	for (auto &i : order) {
+		const IRFunction &func = functions[i.second.first];
+		int size = count_instructions(func.body);
+		if (size > SPECIALIZE_SIZE || growth + size > SPECIALIZE_GROWTH)
+			continue;
+		growth += size;
+		stringstream ss;
+		ss << i.second.first << ".spec" << specialize_count++;
+		clones[i.second] = ss.str();
+		specialized.insert(i.second.first);
+	}
+	for (auto &i : clones)
+		functions[i.second] = specialize(functions[i.first.first], i.second, i.first.second);
+
+	// calls matching a clone go to it, without the constant arguments
+	map<string, bool> called;
+	for (auto &i : functions)
+		for (string &line : i.second.body) {
+			string callee;
+			vector<string> args;
+			if (!parse_call(line, callee, args) || specialized.find(callee) == specialized.end())
+				continue;
+			vector<string> constants, kept;
+			for (const string &arg : args) {
+				constants.push_back(is_constant(arg) ? last_token(arg) : "");
+				if (constants.back().empty())
+					kept.push_back(arg);
+			}
+			auto clone = clones.find(make_pair(callee, constants));
+			if (clone == clones.end()) {
+				// a function only calling itself is no reason to keep it
+				called[callee] = called[callee] || callee != i.first;
+				continue;
+			}
+			size_t at = line.find(" @");
+			string call = line.substr(0, at + 2) + clone->second + "(";
+			for (int j = 0; j < kept.size(); ++j)
+				call += (j ? ", " : "") + kept[j];
+			line = call + line.substr(line.rfind(')'));
+		}
 
-	ResultType result_type;
-	struct Result {
-		ASTNodeExpression* expr;
-		struct {
-			int index; // %1
-			string id; // %local, when index = -1
-			ASTNodeType* type;
-			bool islvalue;
-		} regval;
-		struct {
-			string class_id;
-			int this_index; // %1
-			string this_id; // %local, when this_index = -1
-			ASTNodeFunctionDefn* func;
-		} func;
-	} result;
-	yy::location loc;
-};
+	// the clones follow their function, which goes once no other calls it
+	vector<pair<string, bool>> result;
+	for (auto &line : lines) {
+		if (!line.second || specialized.find(line.first) == specialized.end()) {
+			result.push_back(line);
+			continue;
+		}
+		if (called[line.first])
+			result.push_back(line);
+		else
+			functions.erase(line.first);
+		for (auto &i : clones)
+			if (i.first.first == line.first)
+				result.push_back(make_pair(i.second, true));
+	}
+	lines = result;
+}
+
+// the functions of ir, the code of the program, with calls inlined
+static string inline_functions(const string &ir) {
+	map<string, IRFunction> functions;
+	// the lines out of functions, and the names of the functions in between
+	vector<pair<string, bool>> lines;
+	stringstream in(ir);
+	string line;
+	while (getline(in, line)) {
+		if (line.compare(0, 7, "define ") != 0) {
+			lines.push_back(make_pair(line, false));
+			continue;
+		}
+		size_t at = line.find('@'), open = line.find('(', at);
+		string name = line.substr(at + 1, open - at - 1);
+		IRFunction &func = functions[name];
+		func.head = line;
+		for (const string &param : split_operands(line.substr(open + 1, line.rfind(')') - open - 1)))
+			func.params.push_back(last_token(param).substr(1));
+		while (getline(in, line) && line != "}")
+			func.body.push_back(line);
+		label_blocks(func.body);
+		lines.push_back(make_pair(name, true));
+	}
+
+	for (auto &i : functions)
+		eliminate_tail_calls(i.second, i.first);
+	specialize_functions(functions, lines);
+
+	map<string, int> sites;
+	for (auto &i : functions)
+		sites[i.first] = 0;
+	for (auto &i : functions) {
+		bool returns = false;
+		i.second.inlinable = i.first != "main";
+		for (const string &body_line : i.second.body) {
+			string callee;
+			vector<string> args;
+			if (body_line.compare(0, 6, "  ret ") == 0)
+				returns = true;
+			if (!parse_call(body_line, callee, args))
+				continue;
+			if (callee == "dragon_arena_mark")
+				i.second.inlinable = false;
+			if (functions.find(callee) != functions.end()) {
+				i.second.callees.insert(callee);
+				++sites[callee];
+			}
+		}
+		i.second.inlinable = i.second.inlinable && returns;
+	}
+	// a function calling itself back, directly or not, is never inlined
+	for (auto &i : functions) {
+		set<string> reached;
+		vector<string> stack(i.second.callees.begin(), i.second.callees.end());
+		while (!stack.empty() && reached.find(i.first) == reached.end()) {
+			string name = stack.back();
+			stack.pop_back();
+			if (!reached.insert(name).second)
+				continue;
+			stack.insert(stack.end(), functions[name].callees.begin(), functions[name].callees.end());
+		}
+		if (reached.find(i.first) != reached.end())
+			i.second.inlinable = false;
+	}
+
+	// callees first
+	vector<string> order;
+	set<string> visited;
+	vector<pair<string, bool>> stack;
+	for (auto &i : functions)
+		stack.push_back(make_pair(i.first, false));
+	while (!stack.empty()) {
+		pair<string, bool> top = stack.back();
+		stack.pop_back();
+		if (top.second) {
+			order.push_back(top.first);
+			continue;
+		}
+		if (!visited.insert(top.first).second)
+			continue;
+		stack.push_back(make_pair(top.first, true));
+		for (const string &callee : functions[top.first].callees)
+			if (visited.find(callee) == visited.end())
+				stack.push_back(make_pair(callee, false));
+	}
+	for (const string &name : order) {
+		IRFunction &func = functions[name];
+		func.size = count_instructions(func.body);
+		inline_calls(func, functions, sites);
+	}
+
+	stringstream out;
+	for (auto &out_line : lines) {
+		if (!out_line.second) {
+			out << out_line.first << endl;
+			continue;
+		}
+		const IRFunction &func = functions[out_line.first];
+		out << func.head << endl;
+		for (const string &body_line : func.body)
+			out << body_line << endl;
+		out << "}" << endl;
+	}
+	return out.str();
+}
 
 void ASTNodeProgram::gen_code() {
 	stringstream ss;
@@ -358,6 +2586,23 @@ void ASTNodeProgram::gen_code() {
 	cout.fill(' ');
 	cout << endl;
 
+	// bind the identifiers of every function body before generating any code
+	for (auto i : class_table)
+		for (auto j : *i.second.second->getFuncTable())
+			j.second->resolve(Type::get(i.first), i.second.second);
+	for (auto i : g_func_table)
+		i.second->resolve();
+	for (auto i : class_table)
+		for (auto j : *i.second.second->getFuncTable())
+			optimize_body(j.second->getChildren()[5]);
+	for (auto i : g_func_table)
+		optimize_body(i.second->getChildren()[5]);
+
+	// the functions are generated apart, to be inlined into each other; on
+	// an error the driver takes cout back
+	stringstream functions;
+	streambuf *saved_cout = cout.rdbuf(functions.rdbuf());
+
 	// class functions
 	for (auto i : class_table)
 		i.second.second->gen_code(i.first);
@@ -367,7 +2612,7 @@ void ASTNodeProgram::gen_code() {
 		i.second->gen_code();
 
 	// main()
-	vector<ASTNode*>& local_decl = children[2]->getChildren();
+	ChildList local_decl = children[2]->getChildren();
 	for (int i = 0; i < local_decl.size(); ++i) {
 		string local_id = dynamic_cast<ASTNodeID*>
 			(dynamic_cast<ASTNodeVariableDecl*>(local_decl[i])->getChildren()[0])->getID();
@@ -378,6 +2623,21 @@ void ASTNodeProgram::gen_code() {
 		}
 		localvar_table[local_id] = dynamic_cast<ASTNodeType*>(local_decl[i]->getChildren()[1]);
 	}
+	ResolveInfo resolve_info = { NULL, NULL, NULL, &localvar_table, NULL };
+	children[3]->resolve(&resolve_info);
+	optimize_body(children[3]);
+	// the locals the body never names get no storage
+	set<uint32_t> named;
+	collect_names(children[3], named);
+	// main() is never called recursively, so its large locals can be globals
+	for (auto i : localvar_table) {
+		string s = i.second->getTypeAsm(false);
+		if (named.find(ast_store.intern(i.first)) == named.end())
+			continue;
+		if (!s.empty() && i.second->getType()->getSize() > LARGE_LOCAL_SIZE)
+			cout << "@main." << i.first << " = internal global " << s
+				<< " zeroinitializer, align 16" << endl;
+	}
 	// we never use argc and argv, so hide it through the prefix "..."
 	cout << "define i32 @main(i32 %...argc, i8** %...argv) #2 {" << endl;
 	for (auto i : localvar_table) {
@@ -387,22 +2647,32 @@ void ASTNodeProgram::gen_code() {
 				<< "' is of type '" << i.second->getValue() << "' which is undelcared" << endl;
 			throw runtime_error(ss.str());
 		}
-		cout << "  %" << i.first << " = alloca " << s << ", align 4" << endl;
+		if (named.find(ast_store.intern(i.first)) == named.end())
+			continue;
+		if (i.second->getType()->getSize() > LARGE_LOCAL_SIZE)
+			cout << "  %" << i.first << " = getelementptr inbounds " << s << "* @main."
+				<< i.first << ", i64 0" << endl;
+		else
+			cout << "  %" << i.first << " = alloca " << s << ", align "
+				<< i.second->getType()->getAlign() << endl;
 	}
 
-	ASTNodeType *ret_type = new ASTNodeType(ASTNodeType::INTEGER);
-	GenCodeInfo gen_code_info("", NULL, NULL, NULL, &localvar_table, ret_type, 1);
-	cout << dynamic_cast<ASTNodeBlock*>(children[3])->gen_code(&gen_code_info);
-	delete ret_type;
+	GenCodeInfo gen_code_info("", Type::get(ASTNodeType::INTEGER), 1);
+	string body = dynamic_cast<ASTNodeBlock*>(children[3])->gen_code(&gen_code_info);
+	cout << gen_code_info.entry_alloca << body;
 	if (!gen_code_info.block_isover) {
 		cout << "  ret i32 0" << endl;
 	}
 	else if (gen_code_info.terminated_bybr)
 		cout << "  unreachable" << endl;
 	cout << "}" << endl;
+	cout.rdbuf(saved_cout);
+	cout << inline_functions(functions.str());
 
 	cout << endl;
-	cout << "declare i32 @printf(i8*, ...) #0" << endl;
+	gen_printers();
+	if (uses_runtime)
+		gen_runtime();
 	cout << endl;
 	cout << R"(attributes #0 = { "less-precise-fpmad"="false" "no-frame-pointer-elim"="true" "no-frame-pointer-elim-non-leaf" "no-infs-fp-math"="false" "no-nans-fp-math"="false" "stack-protector-buffer-size"="8" "unsafe-fp-math"="false" "use-soft-float"="false" })" << endl;
 	cout << R"(attributes #1 = { uwtable "less-precise-fpmad"="false" "no-frame-pointer-elim"="true" "no-frame-pointer-elim-non-leaf" "no-infs-fp-math"="false" "no-nans-fp-math"="false" "stack-protector-buffer-size"="8" "unsafe-fp-math"="false" "use-soft-float"="false" })" << endl;
@@ -413,30 +2683,32 @@ void ASTNodeProgram::gen_code() {
 
 void ASTNodeProgram::gen_typedef() {
 	stringstream ss;
+	// resolve the names of declared types
+	for (auto i : class_table)
+		Type::get(i.first)->setClass(i.second.second, i.second.first->getType());
+	for (auto i : array_table) {
+		ASTNodeType* element = dynamic_cast<ASTNodeType*>(i.second->getChildren()[2]);
+		i.second->getType()->setArray(i.second, element->getType(), i.second->getLength());
+	}
+
 	// construct the graph
 	for (auto i : array_table) {
-		ASTNodeType* type = dynamic_cast<ASTNodeType*>(i.second->getChildren()[2]);
-		string var;
-		if ((type->variableType() == ASTNodeType::INTEGER) ||
-				(type->variableType() == ASTNodeType::BOOLEAN)) {
-			var = type->getAsm();
+		ASTNodeType* element = dynamic_cast<ASTNodeType*>(i.second->getChildren()[2]);
+		Type* type = element->getType();
+		if (type->variableType() == ASTNodeType::ARRAY) {
+			i.second->depend(type->getArrayDecl());
+			continue;
 		}
-		else {
-			if (array_table.find(type->getValue()) != array_table.end()) {
-				i.second->depend(array_table[type->getValue()]);
-				continue;
-			}
-			else if (class_table.find(type->getValue()) != class_table.end()) {
-				var = "%class." + type->getValue();
-			}
-			else {
-				ss << type->getLoc() << " error: array '" << i.first << "' is of type '"
-					<< type->getValue() << "' which is undeclared" << endl;
-				throw runtime_error(ss.str());
-			}
+		else if (type->variableType() == ASTNodeType::UNKNOWN) {
+			ss << element->getLoc() << " error: array '" << i.first << "' is of type '"
+				<< type->getValue() << "' which is undeclared" << endl;
+			throw runtime_error(ss.str());
 		}
-		ss << "[" << i.second->getLength() << " x " << var << "]";
-		type->setAsm(ss.str());
+		if (i.second->getType()->isPacked())
+			ss << "[" << (i.second->getLength() + 31) / 32 << " x i32]";
+		else
+			ss << "[" << i.second->getLength() << " x " << type->getAsm() << "]";
+		i.second->getType()->setAsm(ss.str());
 		ss.str("");
 	}
 	// topology sort
@@ -451,9 +2723,8 @@ void ASTNodeProgram::gen_typedef() {
 		ASTNodeArrayDecl* vertex = array_queue.front();
 		vector<ASTNodeArrayDecl*>& dependers = vertex->getDepender();
 		for (ASTNodeArrayDecl* depender : dependers) {
-			ss << "[" << depender->getLength() << " x "
-				<< dynamic_cast<ASTNodeType*>(vertex->getChildren()[2])->getAsm() << "]";
-			dynamic_cast<ASTNodeType*>(depender->getChildren()[2])->setAsm(ss.str());
+			ss << "[" << depender->getLength() << " x " << vertex->getType()->getAsm() << "]";
+			depender->getType()->setAsm(ss.str());
 			ss.str("");
 			depender->decreaseIndegree();
 			if (depender->getIndegree() == 0)
@@ -483,28 +2754,21 @@ void ASTNodeProgram::gen_typedef() {
 	for (auto i : class_table) {
 		map<string, pair<int, ASTNodeType*>>* var_table = i.second.second->getVarTable();
 		vector<string> vars(var_table->size());
+		const ClassLayout &layout = Type::get(i.first)->getLayout();
+		int first_index = i.second.first->variableType() == ASTNodeType::VOID ? 0 : 1;
 		for (auto j : (*var_table)) {
-			ASTNodeType* type = j.second.second;
-			if ((type->variableType() == ASTNodeType::INTEGER) ||
-					(type->variableType() == ASTNodeType::BOOLEAN))
-				vars[j.second.first] = type->getAsm();
-			else {
-				if (array_table.find(type->getValue()) != array_table.end()) {
-					vars[j.second.first] = dynamic_cast<ASTNodeType*>
-						(array_table[type->getValue()]->getChildren()[2])->getAsm();
-				}
-				else if (class_table.find(type->getValue()) != class_table.end()) {
-					vars[j.second.first] = "%class." + type->getValue();
-					ss << type->getLoc() << " var '" << j.first << "' is of type '"
-						<< type->getValue() << "'" << endl;
-					i.second.second->depend(ss.str(), class_table[type->getValue()].second);
-					ss.str("");
-				}
-				else {
-					ss << type->getLoc() << " error: variable '" << j.first << "' is of type '"
-						<< type->getValue() << "' which is undeclared" << endl;
-					throw runtime_error(ss.str());
-				}
+			Type* type = j.second.second->getType();
+			if (type->variableType() == ASTNodeType::UNKNOWN) {
+				ss << j.second.second->getLoc() << " error: variable '" << j.first << "' is of type '"
+					<< type->getValue() << "' which is undeclared" << endl;
+				throw runtime_error(ss.str());
+			}
+			vars[layout.fields.at(ast_store.intern(j.first)).path.back() - first_index] = type->getAsm();
+			if (type->variableType() == ASTNodeType::CLASS) {
+				ss << j.second.second->getLoc() << " var '" << j.first << "' is of type '"
+					<< type->getValue() << "'" << endl;
+				i.second.second->depend(ss.str(), type->getClassBody());
+				ss.str("");
 			}
 		}
 		ss << "%class." << i.first << " = type { ";
@@ -517,12 +2781,9 @@ void ASTNodeProgram::gen_typedef() {
 			stringstream sss;
 			sss << i.second.first->getLoc() << " class '" << i.first
 				<< "' extends '" << i.second.first->getValue() << "'" << endl;
-			i.second.second->depend(sss.str(), class_table[i.second.first->getValue()].second);
+			i.second.second->depend(sss.str(), i.second.first->getType()->getClassBody());
 			if (!vars.empty())
 				ss << ", ";
-			// set the correct index
-			for (auto iter = var_table->begin(); iter != var_table->end(); iter++)
-				iter->second.first++;
 		}
 		if (!vars.empty())
 			ss << vars[0];
@@ -562,14 +2823,33 @@ void ASTNodeProgram::gen_typedef() {
 
 //---------------------Function Definition-------------------------
 
+// returns the name of a new %...tmp<n> of the given type
+static string gen_entry_alloca(GenCodeInfo* gen_code_info, Type *type) {
+	stringstream id, result;
+	id << "...tmp" << gen_code_info->entry_count++;
+	result << "  %" << id.str() << " = alloca " << type->getAsm() << ", align " << type->getAlign() << endl;
+	gen_code_info->entry_alloca += result.str();
+	return id.str();
+}
+
+static string gen_arena_release(GenCodeInfo* gen_code_info) {
+	if (!gen_code_info->arena)
+		return "";
+	return "  store i8* %...arena, i8** @dragon.arena.top, align 8\n";
+}
+
 void ASTNodeFunctionDefn::gen_code(string class_id, ASTNodeClassBody *class_body) {
 	stringstream ss;
 	cout << "define ";
 	// define <ret type>
 	ASTNodeType *ret_type = dynamic_cast<ASTNodeType*>(children[3]);
-	string ret_asm = ret_type->getTypeAsm(false);
+	string ret_asm = ret_type->getType()->getRegAsm();
+	// a class is returned through the caller's %...ret
+	bool sret = ret_type->variableType() == ASTNodeType::CLASS;
 	if (!ret_asm.empty()) {
-		if (ret_asm[0] != '[')
+		if (sret)
+			cout << "void";
+		else if (ret_type->variableType() != ASTNodeType::ARRAY)
 			cout << ret_asm;
 		else {
 			ss << ret_type->getLoc() << " error: array type '"<< ret_type->getValue()
@@ -596,9 +2876,12 @@ void ASTNodeFunctionDefn::gen_code(string class_id, ASTNodeClassBody *class_body
 		else
 			cout << func_name << "(";
 	}
+	// a class argument is passed as a pointer to the caller's object
 	vector<string> paramstr(params.size());
 	for (auto i : params) {
-		string s = i.second.second->getTypeAsm(true);
+		string s = i.second.second->getType()->getRegAsm();
+		if (i.second.second->variableType() == ASTNodeType::CLASS)
+			s += "*";
 		if (!s.empty()) {
 			paramstr[i.second.first] = s + " %" + i.first;
 		}
@@ -608,6 +2891,11 @@ void ASTNodeFunctionDefn::gen_code(string class_id, ASTNodeClassBody *class_body
 			throw runtime_error(ss.str());
 		}
 	}
+	if (sret) {
+		cout << ret_asm << "* noalias sret %...ret";
+		if (!class_id.empty() || !paramstr.empty())
+			cout << ", ";
+	}
 	if (!class_id.empty()) {
 		cout << "%class." << class_id << "* %this";
 		if (!paramstr.empty())
@@ -620,34 +2908,71 @@ void ASTNodeFunctionDefn::gen_code(string class_id, ASTNodeClassBody *class_body
 	// #1 is function attribute uwtable
 	cout << ") #1 {" << endl;
 
-	// parameters
-	int delta = 1;
-	if (!class_id.empty()) {
-		delta = 2;
-		cout << "  %1 = alloca %class." << class_id << "*, align 4" << endl;
-	}
+	// parameters, numbered from %1, except those the body never names,
+	// which get no alloca
+	set<uint32_t> named;
+	collect_names(children[5], named);
+	vector<int> param_slot(params.size(), -1);
+	for (auto i : params)
+		if (named.find(ast_store.intern(i.first)) != named.end())
+			param_slot[i.second.first] = 0;
+	int count = 1;
+	for (int &slot : param_slot)
+		if (slot == 0)
+			slot = count++;
+	// The callee copies a class argument only if it may modify it. A member
+	// function may also reach the caller's object through 'this', and a write
+	// through an array parameter may reach it as an element of that array, so
+	// both always copy.
+	bool copy_classes = !class_id.empty();
+	for (auto i : params)
+		if (i.second.second->variableType() == ASTNodeType::ARRAY &&
+				written_params.find(i.first) != written_params.end())
+			copy_classes = true;
 	for (auto i : params) {
 		stringstream sss;
-		sss << "  %" << (i.second.first + delta) << " = alloca "
-			<< i.second.second->getTypeAsm(true) << ", align 4" << endl;
+		int slot = param_slot[i.second.first];
+		if (slot < 0) {
+			paramstr[i.second.first].clear();
+			continue;
+		}
+		if (i.second.second->variableType() == ASTNodeType::CLASS &&
+				!copy_classes && written_params.find(i.first) == written_params.end())
+			sss << "  %" << slot << " = getelementptr inbounds "
+				<< i.second.second->getTypeAsm(true) << "* %" << i.first << ", i64 0" << endl;
+		else
+			sss << "  %" << slot << " = alloca "
+				<< i.second.second->getTypeAsm(true) << ", align " << i.second.second->getType()->getAlign(true) << endl;
 		paramstr[i.second.first] = sss.str();
 	}
 	for (string str : paramstr)
 		cout << str;
-	if (!class_id.empty())
-		cout << "  store %class." << class_id << "* %this, "
-			<< "%class." << class_id << "** %1, align 4" << endl;
 	for (auto i : params) {
 		stringstream sss;
-		sss << "  store " << i.second.second->getTypeAsm(true) << " %" << i.first << ", "
-			<< i.second.second->getTypeAsm(true) << "* %" << (i.second.first + delta)
-			<< ", align 4" << endl;
+		string s = i.second.second->getTypeAsm(true);
+		int slot = param_slot[i.second.first];
+		if (slot < 0)
+			continue;
+		if (i.second.second->variableType() == ASTNodeType::BOOLEAN) {
+			sss << "  %" << i.first << ".byte = zext i1 %" << i.first << " to i8" << endl;
+			sss << "  store i8 %" << i.first << ".byte, i8* %" << slot << ", align 1" << endl;
+		}
+		else if (i.second.second->variableType() != ASTNodeType::CLASS)
+			sss << "  store " << s << " %" << i.first << ", "
+				<< s << "* %" << slot << ", align " << i.second.second->getType()->getAlign(true) << endl;
+		else if (copy_classes || written_params.find(i.first) != written_params.end()) {
+			int align = i.second.second->getType()->getAlign();
+			sss << "  %" << i.first << ".copy = load " << s << "* %" << i.first << ", align " << align << endl;
+			sss << "  store " << s << " %" << i.first << ".copy, "
+				<< s << "* %" << slot << ", align " << align << endl;
+		}
 		paramstr[i.second.first] = sss.str();
 	}
 	for (string str : paramstr)
 		cout << str;
 
-	// local variables
+	// local variables, but those never named
+	bool arena = false;
 	for (auto i : localvar_table) {
 		string s = i.second->getTypeAsm(false);
 		if (s.empty()) {
@@ -655,24 +2980,34 @@ void ASTNodeFunctionDefn::gen_code(string class_id, ASTNodeClassBody *class_body
 				<< "' is of type '" << i.second->getValue() << "' which is undelcared" << endl;
 			throw runtime_error(ss.str());
 		}
-		cout << "  %" << i.first << " = alloca " << s << ", align 4" << endl;
+		if (named.find(ast_store.intern(i.first)) == named.end())
+			continue;
+		if (i.second->getType()->getSize() > LARGE_LOCAL_SIZE) {
+			if (!arena)
+				cout << "  %...arena = call i8* @dragon_arena_mark()" << endl;
+			arena = true;
+			uses_runtime = true;
+			cout << "  %" << i.first << ".raw = call i8* @dragon_arena_alloc(i64 "
+				<< i.second->getType()->getSize() << ")" << endl;
+			cout << "  %" << i.first << " = bitcast i8* %" << i.first << ".raw to " << s << "*" << endl;
+		}
+		else
+			cout << "  %" << i.first << " = alloca " << s << ", align "
+				<< i.second->getType()->getAlign() << endl;
 	}
 
-	GenCodeInfo* gen_code_info;
-	if (class_id.empty())
-		gen_code_info = new GenCodeInfo(class_id, NULL, NULL,
-				&params, &localvar_table, ret_type, params.size() + 1);
-	else
-		gen_code_info = new GenCodeInfo(class_id, class_body->getFuncTable(), class_body->getVarTable(),
-				&params, &localvar_table, ret_type, params.size() + 2);
-	cout << dynamic_cast<ASTNodeBlock*>(children[5])->gen_code(gen_code_info);
+	GenCodeInfo* gen_code_info = new GenCodeInfo(class_id, ret_type->getType(), count);
+	gen_code_info->param_slot = param_slot;
+	gen_code_info->arena = arena;
+	string body = dynamic_cast<ASTNodeBlock*>(children[5])->gen_code(gen_code_info);
+	cout << gen_code_info->entry_alloca << body;
 	if (!gen_code_info->block_isover) {
 		if (ret_type->variableType() != ASTNodeType::VOID) {
-			ss << loc << " error: control reaches end of non-void function" << endl;
+			ss << getLoc() << " error: control reaches end of non-void function" << endl;
 			throw runtime_error(ss.str());
 		}
 		else
-			cout << "  ret void" << endl;
+			cout << gen_arena_release(gen_code_info) << "  ret void" << endl;
 	}
 	else if (gen_code_info->terminated_bybr)
 		cout << "  unreachable" << endl;
@@ -685,109 +3020,246 @@ void ASTNodeFunctionDefn::gen_code(string class_id, ASTNodeClassBody *class_body
 string ASTNodeExpression::gen_code(GenCodeInfo* gen_code_info) {
 	gen_code_info->result_type = GenCodeInfo::SIMPLE;
 	gen_code_info->result.expr = this;
-	gen_code_info->loc = loc;
+	gen_code_info->loc = getLoc();
 	return "";
 }
 
-static string find_id_byvar(GenCodeInfo* gen_code_info, string id, int &index, ASTNodeType **type) {
-	stringstream ss, result;
-	map<string, pair<int, ASTNodeType*>>* var_table = gen_code_info->var_table;
-	result << "  %" << gen_code_info->tempval_count++ << " = load %class."
-		<< gen_code_info->class_id << "** %1, align 4" << endl;
-	result << "  %" << gen_code_info->tempval_count << " = getelementptr inbounds %class."
-		<< gen_code_info->class_id << "* %" << gen_code_info->tempval_count - 1 << ", i32 0";
-	index = gen_code_info->tempval_count++;
+static string reg(int index) {
+	stringstream ss;
+	ss << "%" << index;
+	return ss.str();
+}
 
-	if (var_table->find(id) != var_table->end()) {
-		*type = (*var_table)[id].second;
-		result << ", i32 " << (*var_table)[id].first << endl;
+// emits "%N = inst" into result and gives N
+static int gen_inst(GenCodeInfo* gen_code_info, stringstream &result, const string &inst) {
+	result << "  %" << gen_code_info->tempval_count << " = " << inst << endl;
+	return gen_code_info->tempval_count++;
+}
+
+static string imm(long long value) {
+	stringstream ss;
+	ss << value;
+	return ss.str();
+}
+
+// the values available in the current block
+static GenCodeInfo::Available& block_values(GenCodeInfo* gen_code_info) {
+	GenCodeInfo::Available &available = gen_code_info->available;
+	if (available.block != gen_code_info->current_block) {
+		available.block = gen_code_info->current_block;
+		available.values.clear();
+		available.memory.clear();
 	}
+	return available;
+}
+
+// makes block, only reached from the current block, the current block; the
+// values available at the end of its predecessor stay available in it
+static void enter_successor(GenCodeInfo* gen_code_info, int block) {
+	if (gen_code_info->available.block == gen_code_info->current_block)
+		gen_code_info->available.block = block;
+	gen_code_info->current_block = block;
+}
+
+// like gen_inst() for an instruction whose value only depends on its operands:
+// the same instruction again in the block, or in a block it dominates through
+// enter_successor(), or hoisted out of the loop, gives the register computed
+// first
+static int gen_pure(GenCodeInfo* gen_code_info, stringstream &result, const string &inst) {
+	GenCodeInfo::Available &available = block_values(gen_code_info);
+	auto i = gen_code_info->invariant.find(inst);
+	if (i != gen_code_info->invariant.end())
+		return i->second;
+	int index;
+	i = available.values.find(inst);
+	if (i != available.values.end())
+		index = i->second;
 	else {
-		ASTNodeType *superclass = class_table[gen_code_info->class_id].first;
-		bool failed = true;
-		while (superclass->variableType() != ASTNodeType::VOID) {
-			result << ", i32 0";
-			var_table = class_table[superclass->getValue()].second->getVarTable();
-			if (var_table->find(id) != var_table->end()) {
-				*type = (*var_table)[id].second;
-				result << ", i32 " << (*var_table)[id].first << endl;
-				failed = false;
-				break;
-			}
-			superclass = class_table[superclass->getValue()].first;
+		index = gen_inst(gen_code_info, result, inst);
+		available.values[inst] = index;
+	}
+	if (gen_code_info->hoisting)
+		gen_code_info->invariant[inst] = index;
+	return index;
+}
+
+static string load_inst(Type *type, const string &ptr) {
+	stringstream ss;
+	ss << "load " << type->getTypeAsm(true) << "* " << ptr << ", align " << type->getAlign(true);
+	return ss.str();
+}
+
+// a store to ptr, a variable, makes the loads of it in the block stale
+static void forget_load(GenCodeInfo* gen_code_info, const string &ptr) {
+	string use = "* " + ptr + ", align";
+	for (map<string, int> *values : {&gen_code_info->available.values, &gen_code_info->available.memory})
+		for (auto i = values->begin(); i != values->end();) {
+			if (i->first.compare(0, 5, "load ") == 0 && i->first.find(use) != string::npos)
+				i = values->erase(i);
+			else
+				++i;
 		}
-		if (failed) {
-			ss << gen_code_info->loc << " error: variable '" << id << "' is used before declared" << endl;
-			throw runtime_error(ss.str());
+}
+
+// a call may change whatever was loaded from memory
+static void forget_memory(GenCodeInfo* gen_code_info) {
+	gen_code_info->available.memory.clear();
+}
+
+// the getelementptr computing ptr, if it has constant indices only
+static string constant_address(GenCodeInfo* gen_code_info, const string &ptr) {
+	for (map<string, int> *values : {&gen_code_info->available.values, &gen_code_info->invariant})
+		for (auto &i : *values) {
+			if (reg(i.second) != ptr || i.first.compare(0, 14, "getelementptr ") != 0)
+				continue;
+			size_t operand = i.first.find(", ");
+			if (operand == string::npos || i.first.find("%", operand) != string::npos)
+				return "";
+			return i.first;
 		}
+	return "";
+}
+
+// a store to ptr, in memory, may change what was loaded from anywhere but
+// the other fields of the same object
+static void forget_memory(GenCodeInfo* gen_code_info, const string &ptr) {
+	map<string, int> &memory = gen_code_info->available.memory;
+	string address = constant_address(gen_code_info, ptr) + ",";
+	for (auto i = memory.begin(); i != memory.end();) {
+		size_t begin = i->first.find("* ") + 2;
+		string other = constant_address(gen_code_info, i->first.substr(begin, i->first.find(",") - begin)) + ",";
+		// same base, and neither path contains the other
+		size_t base = address.find(", ");
+		if (address.size() == 1 || other.size() == 1 || address.compare(0, base, other, 0, base) != 0 ||
+				other.compare(0, address.size(), address) == 0 || address.compare(0, other.size(), other) == 0)
+			i = memory.erase(i);
+		else
+			++i;
 	}
+}
+
+// loads the value at ptr, in memory, which is the value last stored or loaded
+// there in the block if nothing was stored to memory since
+static int gen_load_memory(GenCodeInfo* gen_code_info, stringstream &result, Type *type, const string &ptr) {
+	map<string, int> &memory = block_values(gen_code_info).memory;
+	string inst = load_inst(type, ptr);
+	auto i = memory.find(inst);
+	if (i != memory.end())
+		return i->second;
+	return memory[inst] = gen_inst(gen_code_info, result, inst);
+}
+
+static string find_id_byvar(GenCodeInfo* gen_code_info, const Binding &binding, int &index, Type **type) {
+	stringstream result, gep;
+	gep << "getelementptr inbounds %class." << gen_code_info->class_id << "* %this, i32 0";
+	for (int i : *binding.path)
+		gep << ", i32 " << i;
+	index = gen_pure(gen_code_info, result, gep.str());
+	*type = binding.type;
 	return result.str();
 }
 
-static string find_id(GenCodeInfo* gen_code_info, string id, int &index, string &index_id, ASTNodeType **type) {
+static string find_id(GenCodeInfo* gen_code_info, ASTNodeID *id_node, int &index, string &index_id, Type **type) {
 	stringstream ss;
 	string ret;
-	if (gen_code_info->params &&
-			gen_code_info->params->find(id) != gen_code_info->params->end()) {
-		index = (*(gen_code_info->params))[id].first + 1;
-		if (!gen_code_info->class_id.empty())
-			index++;
-		*type = (*(gen_code_info->params))[id].second;
-	}
-	else if (gen_code_info->localvar_table &&
-			gen_code_info->localvar_table->find(id) != gen_code_info->localvar_table->end()) {
+	const Binding &binding = id_node->getBinding();
+	if (binding.kind == Binding::PARAM) {
+		index = gen_code_info->param_slot[binding.slot];
+		*type = binding.type;
+	}
+	else if (binding.kind == Binding::LOCAL) {
 		index = -1;
-		index_id = id;
-		*type = (*(gen_code_info->localvar_table))[id];
+		index_id = id_node->getID();
+		*type = binding.type;
 	}
-	else if (gen_code_info->var_table) {
-		ret = find_id_byvar(gen_code_info, id, index, type);
+	else if (binding.kind == Binding::FIELD) {
+		auto slot = gen_code_info->promoted.find(*binding.path);
+		if (slot != gen_code_info->promoted.end()) {
+			index = -1;
+			index_id = slot->second;
+			*type = binding.type;
+		}
+		else
+			ret = find_id_byvar(gen_code_info, binding, index, type);
 	}
 	else {
-		ss << gen_code_info->loc << " error: variable '" << id << "' is used before declared" << endl;
+		ss << gen_code_info->loc << " error: variable '" << id_node->getID() << "' is used before declared" << endl;
 		throw runtime_error(ss.str());
 	}
 	return ret;
 }
 
-static string load_id(GenCodeInfo* gen_code_info, ASTNodeExpression* expr, int &index, string *index_id, ASTNodeType **type) {
+// loads the value at ptr into a register, where a boolean is truncated to i1
+static string gen_load(GenCodeInfo* gen_code_info, Type *type, const string &ptr, int &index) {
+	stringstream result;
+	index = gen_load_memory(gen_code_info, result, type, ptr);
+	if (type->variableType() == ASTNodeType::BOOLEAN)
+		index = gen_pure(gen_code_info, result, "trunc i8 " + reg(index) + " to i1");
+	return result.str();
+}
+
+// the same for a local or a parameter, only changed by assignments, so that
+// it's loaded once in a block until it's stored to
+static string gen_load_var(GenCodeInfo* gen_code_info, Type *type, const string &ptr, int &index) {
+	stringstream result;
+	index = gen_pure(gen_code_info, result, load_inst(type, ptr));
+	if (type->variableType() == ASTNodeType::BOOLEAN)
+		index = gen_pure(gen_code_info, result, "trunc i8 " + reg(index) + " to i1");
+	return result.str();
+}
+
+// the same for a POINTER result
+static string gen_load(GenCodeInfo* gen_code_info, GenCodeInfo::Result &result) {
+	stringstream ptr;
+	ptr << "%";
+	if (result.regval.index >= 0)
+		ptr << result.regval.index;
+	else
+		ptr << result.regval.id;
+	return gen_load(gen_code_info, result.regval.type, ptr.str(), result.regval.index);
+}
+
+static string load_id(GenCodeInfo* gen_code_info, ASTNodeExpression* expr, int &index, string *index_id, Type **type) {
 	// load array as pointer ([i x type]*)
 	stringstream ss, result;
-	string id = dynamic_cast<ASTNodeID*>(expr)->getID();
-	if (gen_code_info->params &&
-			gen_code_info->params->find(id) != gen_code_info->params->end()) {
-		index = (*(gen_code_info->params))[id].first + 1;
-		if (!gen_code_info->class_id.empty())
-			index++;
-		*type = (*(gen_code_info->params))[id].second;
-		result << "  %" << gen_code_info->tempval_count << " = load "
-			<< (*type)->getTypeAsm(true) << "* %" << index << ", align 4" << endl;
-		index = gen_code_info->tempval_count++;
-	}
-	else if (gen_code_info->localvar_table &&
-			gen_code_info->localvar_table->find(id) != gen_code_info->localvar_table->end()) {
-		*type = (*(gen_code_info->localvar_table))[id];
-		if (array_table.find((*type)->getValue()) != array_table.end()) {
+	ASTNodeID *id_node = dynamic_cast<ASTNodeID*>(expr);
+	const Binding &binding = id_node->getBinding();
+	if (binding.kind == Binding::PARAM) {
+		*type = binding.type;
+		stringstream ptr;
+		ptr << "%" << gen_code_info->param_slot[binding.slot];
+		if ((*type)->variableType() == ASTNodeType::CLASS)
+			result << gen_load(gen_code_info, *type, ptr.str(), index);
+		else
+			result << gen_load_var(gen_code_info, *type, ptr.str(), index);
+	}
+	else if (binding.kind == Binding::LOCAL) {
+		*type = binding.type;
+		if ((*type)->variableType() == ASTNodeType::ARRAY) {
 			index = -1;
 			if (index_id)
-				*index_id = id;
-		}
-		else {
-			result << "  %" << gen_code_info->tempval_count << " = load "
-				<< (*type)->getTypeAsm(false) << "* %" << id << ", align 4" << endl;
-			index = gen_code_info->tempval_count++;
+				*index_id = id_node->getID();
 		}
+		else if ((*type)->variableType() == ASTNodeType::CLASS)
+			result << gen_load(gen_code_info, *type, "%" + id_node->getID(), index);
+		else
+			result << gen_load_var(gen_code_info, *type, "%" + id_node->getID(), index);
 	}
-	else if (gen_code_info->var_table) {
-		result << find_id_byvar(gen_code_info, id, index, type);
-		if (array_table.find((*type)->getValue()) == array_table.end()) {
-			result << "  %" << gen_code_info->tempval_count << " = load "
-				<< (*type)->getTypeAsm(false) << "* %" << index << ", align 4" << endl;
-			index = gen_code_info->tempval_count++;
+	else if (binding.kind == Binding::FIELD) {
+		auto slot = gen_code_info->promoted.find(*binding.path);
+		if (slot != gen_code_info->promoted.end()) {
+			*type = binding.type;
+			return gen_load_var(gen_code_info, *type, "%" + slot->second, index);
+		}
+		result << find_id_byvar(gen_code_info, binding, index, type);
+		if ((*type)->variableType() != ASTNodeType::ARRAY) {
+			stringstream ptr;
+			ptr << "%" << index;
+			result << gen_load(gen_code_info, *type, ptr.str(), index);
 		}
 	}
 	else {
-		ss << gen_code_info->loc << " error: variable '" << id << "' is used before declared" << endl;
+		ss << gen_code_info->loc << " error: variable '" << id_node->getID() << "' is used before declared" << endl;
 		throw runtime_error(ss.str());
 	}
 	return result.str();
@@ -805,13 +3277,13 @@ string ASTNodeFieldAccess::gen_asm(GenCodeInfo* gen_code_info, ASTNodeFieldAcces
 	// phase 1, get proper information
 	int func_this_index;
 	string func_this_id;
-	ASTNodeType* type;
+	Type* type;
 	stringstream pre_result, result;
 	if (lvaltype == ID) {
 		gen_code_info->result.regval.islvalue = true;
-		pre_result << find_id(gen_code_info, id, func_this_index, func_this_id, &type);
-		result << "  %" << gen_code_info->tempval_count << " = getelementptr inbounds %class."
-			<< type->getValue() << "* %";
+		pre_result << find_id(gen_code_info, dynamic_cast<ASTNodeID*>(gen_code_info->result.expr),
+				func_this_index, func_this_id, &type);
+		result << "getelementptr inbounds %class." << type->getValue() << "* %";
 		if (func_this_index >= 0)
 			result << func_this_index;
 		else
@@ -820,22 +3292,17 @@ string ASTNodeFieldAccess::gen_asm(GenCodeInfo* gen_code_info, ASTNodeFieldAcces
 	}
 	else if (lvaltype == THISPOINTER) {
 		gen_code_info->result.regval.islvalue = true;
-		// add to children so that it can be automatically deleted
-		type = new ASTNodeType(gen_code_info->class_id);
-		children.push_back(type);
-		pre_result << "  %" << gen_code_info->tempval_count << " = load %class."
-			<< gen_code_info->class_id << "** %1, align 4" << endl;
-		func_this_index = gen_code_info->tempval_count++;
-		result << "  %" << gen_code_info->tempval_count << " = getelementptr inbounds %class."
-			<< gen_code_info->class_id << "* %" << func_this_index << ", i32 0";
+		type = gen_code_info->this_type;
+		func_this_index = -1;
+		func_this_id = "this";
+		result << "getelementptr inbounds %class." << gen_code_info->class_id << "* %this, i32 0";
 	}
 	else if (lvaltype == COMPOSED) {
 		// islvalue will not change
 		func_this_index = gen_code_info->result.regval.index;
 		func_this_id = gen_code_info->result.regval.id;
 		type = gen_code_info->result.regval.type;
-		result << "  %" << gen_code_info->tempval_count << " = getelementptr inbounds %class."
-			<< type->getValue() << "* %";
+		result << "getelementptr inbounds %class." << type->getValue() << "* %";
 		if (func_this_index >= 0)
 			result << func_this_index;
 		// consider a = b.c(), where local variable a is of class A and b.c() returns class A
@@ -853,65 +3320,52 @@ string ASTNodeFieldAccess::gen_asm(GenCodeInfo* gen_code_info, ASTNodeFieldAcces
 		ss << gen_code_info->loc << " error: can't use operator '.' on boolean" << endl;
 		throw runtime_error(ss.str());
 	}
-	else if (array_table.find(type->getValue()) != array_table.end()) {
+	else if (type->variableType() == ASTNodeType::ARRAY) {
 		ss << gen_code_info->loc << " error: can't use operator '.' on array type '" << type->getValue() << "'" << endl;
 		throw runtime_error(ss.str());
 	}
-	else if (class_table.find(type->getValue()) == class_table.end())
+	else if (type->variableType() != ASTNodeType::CLASS)
 		throw runtime_error("panic: unexpected code path, BUG in code!\n");
 
 	// phase 2, generate the pointer
-	map<string, pair<int, ASTNodeType*>>* param_var_table = class_table[type->getValue()].second->getVarTable();
-	map<string, ASTNodeFunctionDefn*>* param_func_table = class_table[type->getValue()].second->getFuncTable();
-
-	if (param_var_table->find(rid) != param_var_table->end()) {
-		// direct member access
-		result << ", i32 " << (*param_var_table)[rid].first << endl;
+	const ClassLayout &layout = type->getLayout();
+	uint32_t name = dynamic_cast<ASTNodeID*>(children[1])->getNameId();
+	auto field = layout.fields.find(name);
+	auto method = layout.methods.find(name);
+	// a member of the class hides a member of the same name in super classes
+	if (field != layout.fields.end() &&
+			(method == layout.methods.end() || field->second.depth < method->second.depth)) {
+		auto slot = gen_code_info->promoted.find(field->second.path);
+		for (int i : field->second.path)
+			result << ", i32 " << i;
 		gen_code_info->result_type = GenCodeInfo::POINTER;
-		gen_code_info->result.regval.index = gen_code_info->tempval_count++;
-		gen_code_info->result.regval.type = (*param_var_table)[rid].second;
-		gen_code_info->loc = loc;
-		return pre_result.str() + result.str();
+		if (lvaltype == THISPOINTER && slot != gen_code_info->promoted.end()) {
+			gen_code_info->result.regval.index = -1;
+			gen_code_info->result.regval.id = slot->second;
+		}
+		else
+			gen_code_info->result.regval.index = gen_pure(gen_code_info, pre_result, result.str());
+		gen_code_info->result.regval.type = field->second.type;
+		gen_code_info->loc = getLoc();
+		return pre_result.str();
 	}
-	else if (param_func_table->find(rid) != param_func_table->end()) {
-		// direct function access
+	else if (method != layout.methods.end()) {
 		gen_code_info->result_type = GenCodeInfo::FUNCTION;
-		gen_code_info->result.func.class_id = type->getValue();
-		gen_code_info->result.func.this_index = func_this_index;
-		gen_code_info->result.func.this_id = func_this_id;
-		gen_code_info->result.func.func = (*param_func_table)[rid];
-		gen_code_info->loc = loc;
+		gen_code_info->result.func.class_id = method->second.owner->getValue();
+		gen_code_info->result.func.func = method->second.func;
+		gen_code_info->loc = getLoc();
+		if (method->second.depth == 0) {
+			gen_code_info->result.func.this_index = func_this_index;
+			gen_code_info->result.func.this_id = func_this_id;
+			return pre_result.str();
+		}
+		// cast 'this' to the super class defining the method
+		for (int i = 0; i < method->second.depth; ++i)
+			result << ", i32 0";
+		gen_code_info->result.func.this_index = gen_pure(gen_code_info, pre_result, result.str());
 		return pre_result.str();
 	}
 	else {
-		// super class member/function access
-		ASTNodeType* superclass = class_table[type->getValue()].first;
-		while (superclass->variableType() != ASTNodeType::VOID) {
-			result << ", i32 0";
-			param_var_table = class_table[superclass->getValue()].second->getVarTable();
-			param_func_table = class_table[superclass->getValue()].second->getFuncTable();
-			if (param_var_table->find(rid) != param_var_table->end()) {
-				// super class member access
-				result << ", i32 " << (*param_var_table)[rid].first << endl;
-				gen_code_info->result_type = GenCodeInfo::POINTER;
-				gen_code_info->result.regval.index = gen_code_info->tempval_count++;
-				gen_code_info->result.regval.type = (*param_var_table)[rid].second;
-				gen_code_info->loc = loc;
-				return pre_result.str() + result.str();
-			}
-			else if (param_func_table->find(rid) != param_func_table->end()) {
-				// super class function access
-				result << endl;
-				gen_code_info->result_type = GenCodeInfo::FUNCTION;
-				gen_code_info->result.func.class_id = superclass->getValue();
-				gen_code_info->result.func.this_index = gen_code_info->tempval_count++;
-				gen_code_info->result.func.func = (*param_func_table)[rid];
-				gen_code_info->loc = loc;
-				return pre_result.str() + result.str();
-			}
-			superclass = class_table[superclass->getValue()].first;
-		}
-
 		if (!id.empty()) {
 			ss << gen_code_info->loc << " error: variable '" << id
 				<< "' has no member '" << rid << "'" << endl;
@@ -933,11 +3387,12 @@ string ASTNodeFieldAccess::gen_composed(GenCodeInfo* gen_code_info) {
 	stringstream result;
 	if (gen_code_info->result_type == GenCodeInfo::VALUE) {
 		string class_id = gen_code_info->result.regval.type->getValue();
+		int align = gen_code_info->result.regval.type->getAlign();
 		result << "  %" << gen_code_info->tempval_count << " = alloca %class."
-			<< class_id << "*, align 4" << endl;
+			<< class_id << ", align " << align << endl;
 		// intermediate value will aways be anonymous, so we can index by int safely
 		result << "  store %class." << class_id << " %" << gen_code_info->result.regval.index
-			<< ", %class." << class_id << "* %" << gen_code_info->tempval_count << ", align 4" << endl;
+			<< ", %class." << class_id << "* %" << gen_code_info->tempval_count << ", align " << align << endl;
 		gen_code_info->result.regval.index = gen_code_info->tempval_count++;
 	}
 	result << gen_asm(gen_code_info, COMPOSED);
@@ -993,17 +3448,17 @@ string ASTNodeFieldAccess::gen_code(GenCodeInfo* gen_code_info) {
 	}
 	else if (gen_code_info->result_type == GenCodeInfo::POINTER ||
 			gen_code_info->result_type == GenCodeInfo::VALUE) {
-		ASTNodeType* type = gen_code_info->result.regval.type;
+		Type* type = gen_code_info->result.regval.type;
 		if (type->variableType() == ASTNodeType::INTEGER ||
 				type->variableType() == ASTNodeType::BOOLEAN) {
 			ss << gen_code_info->loc << " error: can't use operator '.' on " << type->getValue() << endl;
 			throw runtime_error(ss.str());
 		}
-		else if (array_table.find(type->getValue()) != array_table.end()) {
+		else if (type->variableType() == ASTNodeType::ARRAY) {
 			ss << gen_code_info->loc << " error: can't use operator '.' on array type '" << type->getValue() << "'" << endl;
 			throw runtime_error(ss.str());
 		}
-		else if (class_table.find(type->getValue()) != class_table.end()) {
+		else if (type->variableType() == ASTNodeType::CLASS) {
 			return ret + gen_composed(gen_code_info);
 		}
 		else {
@@ -1014,7 +3469,57 @@ string ASTNodeFieldAccess::gen_code(GenCodeInfo* gen_code_info) {
 	return ret;
 }
 
-void ASTNodeArrayAccess::check_type(GenCodeInfo* gen_code_info, ASTNodeType* type) {
+// address of the word holding element %<subscript> (or the constant value when
+// subscript is -1) of a packed array, and the mask selecting its bit
+static string gen_bit_address(GenCodeInfo* gen_code_info, Type *array, const string &array_ptr,
+		int subscript, int value, int &index, string &mask) {
+	stringstream result, gep;
+	int word;
+	if (subscript >= 0) {
+		word = gen_pure(gen_code_info, result, "lshr i32 " + reg(subscript) + ", 5");
+		int bit = gen_pure(gen_code_info, result, "and i32 " + reg(subscript) + ", 31");
+		mask = reg(gen_pure(gen_code_info, result, "shl i32 1, " + reg(bit)));
+	}
+	else
+		mask = imm(int(1u << (value & 31)));
+	gep << "getelementptr inbounds " << array->getAsm() << "* " << array_ptr << ", i32 0, i32 ";
+	if (subscript >= 0)
+		gep << "%" << word;
+	else
+		gep << (value >> 5);
+	index = gen_pure(gen_code_info, result, gep.str());
+	return result.str();
+}
+
+static string gen_load_bit(GenCodeInfo* gen_code_info, int ptr, const string &mask, int &index) {
+	stringstream result;
+	result << "  %" << gen_code_info->tempval_count++ << " = load i32* %" << ptr << ", align 4" << endl;
+	result << "  %" << gen_code_info->tempval_count << " = and i32 %"
+		<< gen_code_info->tempval_count - 1 << ", " << mask << endl;
+	gen_code_info->tempval_count++;
+	result << "  %" << gen_code_info->tempval_count << " = icmp ne i32 %"
+		<< gen_code_info->tempval_count - 1 << ", 0" << endl;
+	index = gen_code_info->tempval_count++;
+	return result.str();
+}
+
+// value is an i1 operand
+static string gen_store_bit(GenCodeInfo* gen_code_info, int ptr, const string &mask, const string &value) {
+	stringstream result;
+	int word = gen_code_info->tempval_count++;
+	result << "  %" << word << " = load i32* %" << ptr << ", align 4" << endl;
+	result << "  %" << gen_code_info->tempval_count++ << " = or i32 %" << word << ", " << mask << endl;
+	result << "  %" << gen_code_info->tempval_count++ << " = xor i32 " << mask << ", -1" << endl;
+	result << "  %" << gen_code_info->tempval_count << " = and i32 %" << word << ", %"
+		<< gen_code_info->tempval_count - 1 << endl;
+	gen_code_info->tempval_count++;
+	result << "  %" << gen_code_info->tempval_count << " = select i1 " << value << ", i32 %"
+		<< word + 1 << ", i32 %" << word + 3 << endl;
+	result << "  store i32 %" << gen_code_info->tempval_count++ << ", i32* %" << ptr << ", align 4" << endl;
+	return result.str();
+}
+
+void ASTNodeArrayAccess::check_type(GenCodeInfo* gen_code_info, Type* type) {
 	stringstream ss;
 	if (type->variableType() == ASTNodeType::INTEGER) {
 		ss << gen_code_info->loc << " error: can't use operator '[]' on integer" << endl;
@@ -1024,11 +3529,11 @@ void ASTNodeArrayAccess::check_type(GenCodeInfo* gen_code_info, ASTNodeType* typ
 		ss << gen_code_info->loc << " error: can't use operator '[]' on boolean" << endl;
 		throw runtime_error(ss.str());
 	}
-	else if (class_table.find(type->getValue()) != class_table.end()) {
+	else if (type->variableType() == ASTNodeType::CLASS) {
 		ss << gen_code_info->loc << " error: can't use operator '[]' on class type '" << type->getValue() << "'" << endl;
 		throw runtime_error(ss.str());
 	}
-	else if (array_table.find(type->getValue()) == array_table.end())
+	else if (type->variableType() != ASTNodeType::ARRAY)
 		throw runtime_error("panic: unexpected code path, BUG in code!\n");
 }
 
@@ -1041,42 +3546,38 @@ string ASTNodeArrayAccess::gen_asm(GenCodeInfo* gen_code_info, ASTNodeFieldAcces
 	}
 
 	string ret;
-	stringstream pre_result, result;
-	ASTNodeType* type;
+	stringstream pre_result, array_ptr;
+	Type* type;
 	bool islvalue;
 	if (lvaltype == ID) {
 		int array_index;
 		string array_id;
 		bool isparam;
 		islvalue = true;
-		ret = find_id(gen_code_info, id, array_index, array_id, &type);
+		ret = find_id(gen_code_info, dynamic_cast<ASTNodeID*>(gen_code_info->result.expr),
+				array_index, array_id, &type);
 		check_type(gen_code_info, type);
-		string type_asm = dynamic_cast<ASTNodeType*>
-			(array_table[type->getValue()]->getChildren()[2])->getAsm();
-		if (gen_code_info->params &&
-			(gen_code_info->params->find(id) != gen_code_info->params->end())) {
-			pre_result << "  %" << gen_code_info->tempval_count << " = load "
-				<< type_asm << "** %" << array_index << ", align 4" << endl;
-			array_index = gen_code_info->tempval_count++;
-		}
-		result << " = getelementptr inbounds " << type_asm;
-		result << "* %";
+		if (dynamic_cast<ASTNodeID*>(gen_code_info->result.expr)->getBinding().kind == Binding::PARAM) {
+			// an array can't be assigned, so the parameter still holds the argument
+			array_index = -1;
+			array_id = dynamic_cast<ASTNodeID*>(gen_code_info->result.expr)->getID();
+		}
+		array_ptr << "%";
 		if (array_index >= 0)
-			result << array_index;
+			array_ptr << array_index;
 		else
-			result << array_id;
-		result << ", i32 0";
+			array_ptr << array_id;
 	}
 	else if (lvaltype == COMPOSED) {
 		islvalue = gen_code_info->result.regval.islvalue;
 		// intermediate arrays may not be stored in register
 		type = gen_code_info->result.regval.type;
 		check_type(gen_code_info, type);
-		result << " = getelementptr inbounds " << dynamic_cast<ASTNodeType*>
-			(array_table[type->getValue()]->getChildren()[2])->getAsm() << "* %"
-			<< gen_code_info->result.regval.index << ", i32 0";
+		array_ptr << "%" << gen_code_info->result.regval.index;
 	}
 
+	// the subscript is %<subscript_index>, or value when it is -1
+	int subscript_index = -1, value = 0;
 	ret += dynamic_cast<ASTNodeExpression*>(children[1])->gen_code(gen_code_info);
 	if (gen_code_info->result_type == GenCodeInfo::NONE ||
 			gen_code_info->result_type == GenCodeInfo::FUNCTION) {
@@ -1085,39 +3586,28 @@ string ASTNodeArrayAccess::gen_asm(GenCodeInfo* gen_code_info, ASTNodeFieldAcces
 	}
 	else if (gen_code_info->result_type == GenCodeInfo::POINTER ||
 			gen_code_info->result_type == GenCodeInfo::VALUE) {
-		ASTNodeType* type = gen_code_info->result.regval.type; // shadows the type of array
+		Type* type = gen_code_info->result.regval.type; // shadows the type of array
 		if (type->variableType() != ASTNodeType::INTEGER &&
 				type->variableType() != ASTNodeType::BOOLEAN) {
 			ss << gen_code_info->loc << " error: array subscript is not an integer" << endl;
 			throw runtime_error(ss.str());
 		}
-		int subscript_index = gen_code_info->result.regval.index;
-		string subscript_id = gen_code_info->result.regval.id;
 		stringstream sss;
-		if (gen_code_info->result_type == GenCodeInfo::POINTER) {
-			sss << "  %" << gen_code_info->tempval_count << " = load " << type->getAsm() << "* %";
-			if (subscript_index >= 0)
-				sss << subscript_index;
-			else
-				sss << subscript_id;
-			sss << ", align 4" << endl;
-			subscript_index = gen_code_info->tempval_count++;
-		}
+		if (gen_code_info->result_type == GenCodeInfo::POINTER)
+			sss << gen_load(gen_code_info, gen_code_info->result);
+		subscript_index = gen_code_info->result.regval.index;
 		if (type->variableType() == ASTNodeType::BOOLEAN) {
-			sss << "  %" << gen_code_info->tempval_count << " = zext i8 %"
+			sss << "  %" << gen_code_info->tempval_count << " = zext i1 %"
 				<< subscript_index << " to i32" << endl;
 			subscript_index = gen_code_info->tempval_count++;
 		}
-		sss << "  %" << gen_code_info->tempval_count << result.str()
-			<< ", i32 %" << subscript_index << endl;
 		ret += sss.str();
 	}
 	else { // SIMPLE
 		stringstream sss;
 		ASTNodeExpression* expr = gen_code_info->result.expr;
 		if (expr->type() == ASTNode::INTEGER || expr->type() == ASTNode::BOOLEAN) {
-			int value;
-			int length = array_table[type->getValue()]->getLength();
+			int length = type->getLength();
 			if (expr->type() == ASTNode::INTEGER)
 				value = dynamic_cast<ASTNodeInteger*>(expr)->getValue();
 			else
@@ -1127,9 +3617,6 @@ string ASTNodeArrayAccess::gen_asm(GenCodeInfo* gen_code_info, ASTNodeFieldAcces
 					<< length - 1 << " but get " << value << " )" << endl;
 				throw runtime_error(ss.str());
 			}
-			sss << "  %" << gen_code_info->tempval_count << result.str()
-				<< ", i32 " << value << endl;
-			ret += sss.str();
 		}
 		else if (expr->type() == ASTNode::STRING || expr->type() == ASTNode::THIS) {
 			ss << gen_code_info->loc << " error: array subscript is not an integer" << endl;
@@ -1137,13 +3624,13 @@ string ASTNodeArrayAccess::gen_asm(GenCodeInfo* gen_code_info, ASTNodeFieldAcces
 		}
 		else if (expr->type() == ASTNode::IDENTIFIER) {
 			int index;
-			ASTNodeType* type; // shadows the type of array
+			Type* type; // shadows the type of array
 			ret += load_id(gen_code_info, expr, index, NULL, &type);
 			if (type->variableType() == ASTNodeType::INTEGER ||
 					type->variableType() == ASTNodeType::BOOLEAN) {
 				if (type->variableType() == ASTNodeType::BOOLEAN) {
-					result << "  %" << gen_code_info->tempval_count
-						<< " = zext i8 %" << index << " to i32" << endl;
+					sss << "  %" << gen_code_info->tempval_count
+						<< " = zext i1 %" << index << " to i32" << endl;
 					index = gen_code_info->tempval_count++;
 				}
 			}
@@ -1151,19 +3638,40 @@ string ASTNodeArrayAccess::gen_asm(GenCodeInfo* gen_code_info, ASTNodeFieldAcces
 				ss << gen_code_info->loc << " error: array subscript is not an integer" << endl;
 				throw runtime_error(ss.str());
 			}
-			sss << "  %" << gen_code_info->tempval_count << result.str()
-				<< ", i32 %" << index << endl;
+			subscript_index = index;
 			ret += sss.str();
 		}
 	}
-	gen_code_info->result_type = GenCodeInfo::POINTER;
-	gen_code_info->result.regval.index = gen_code_info->tempval_count++;
-	type = dynamic_cast<ASTNodeType*>(array_table[type->getValue()]->getChildren()[2]);
-	gen_code_info->result.regval.type = new ASTNodeType(type->getValue());
-	children.push_back(gen_code_info->result.regval.type);
+
+	gen_code_info->result.regval.type = type->getElement();
 	gen_code_info->result.regval.islvalue = islvalue;
-	gen_code_info->loc = loc;
-	return pre_result.str() + ret;
+	gen_code_info->loc = getLoc();
+	if (type->isPacked()) {
+		int word;
+		string mask;
+		ret += gen_bit_address(gen_code_info, type, array_ptr.str(), subscript_index, value, word, mask);
+		if (gen_code_info->packed_lvalue == this) {
+			gen_code_info->result_type = GenCodeInfo::POINTER;
+			gen_code_info->result.regval.index = word;
+			gen_code_info->packed_mask = mask;
+		}
+		else {
+			// a bit has no address, so the element is read right away
+			ret += gen_load_bit(gen_code_info, word, mask, gen_code_info->result.regval.index);
+			gen_code_info->result_type = GenCodeInfo::VALUE;
+			gen_code_info->result.regval.islvalue = false;
+		}
+		return pre_result.str() + ret;
+	}
+	stringstream result, gep;
+	gep << "getelementptr inbounds " << type->getAsm() << "* " << array_ptr.str() << ", i32 0, i32 ";
+	if (subscript_index >= 0)
+		gep << "%" << subscript_index;
+	else
+		gep << value;
+	gen_code_info->result_type = GenCodeInfo::POINTER;
+	gen_code_info->result.regval.index = gen_pure(gen_code_info, result, gep.str());
+	return pre_result.str() + ret + result.str();
 }
 
 string ASTNodeArrayAccess::gen_simple(GenCodeInfo* gen_code_info) {
@@ -1216,17 +3724,17 @@ string ASTNodeArrayAccess::gen_code(GenCodeInfo* gen_code_info) {
 	}
 	else if (gen_code_info->result_type == GenCodeInfo::POINTER ||
 			gen_code_info->result_type == GenCodeInfo::VALUE) {
-		ASTNodeType* type = gen_code_info->result.regval.type;
+		Type* type = gen_code_info->result.regval.type;
 		if (type->variableType() == ASTNodeType::INTEGER ||
 				type->variableType() == ASTNodeType::BOOLEAN) {
 			ss << gen_code_info->loc << " error: can't use operator '[]' on " << type->getValue() << endl;
 			throw runtime_error(ss.str());
 		}
-		else if (class_table.find(type->getValue()) != class_table.end()) {
+		else if (type->variableType() == ASTNodeType::CLASS) {
 			ss << gen_code_info->loc << " error: can't use operator '[]' on class type '" << type->getValue() << "'" << endl;
 			throw runtime_error(ss.str());
 		}
-		else if (array_table.find(type->getValue()) != array_table.end()) {
+		else if (type->variableType() == ASTNodeType::ARRAY) {
 			if (gen_code_info->result_type == GenCodeInfo::VALUE) {
 				ss << gen_code_info->loc << " panic: array type found in a register value, BUG in code!" << endl;
 				throw runtime_error(ss.str());
@@ -1241,12 +3749,31 @@ string ASTNodeArrayAccess::gen_code(GenCodeInfo* gen_code_info) {
 	return ret;
 }
 
+// whether result, an operand of an assignment, is a local, a parameter or a
+// promoted field of integer or boolean type, which only assignments change
+static bool is_variable(GenCodeInfo::ResultType result_type, const GenCodeInfo::Result &result) {
+	if (result_type != GenCodeInfo::SIMPLE || result.expr->type() != ASTNode::IDENTIFIER)
+		return false;
+	ASTNodeType::VariableType type = result.regval.type->variableType();
+	if (type != ASTNodeType::INTEGER && type != ASTNodeType::BOOLEAN)
+		return false;
+	return dynamic_cast<ASTNodeID*>(result.expr)->getBinding().kind != Binding::FIELD || result.regval.index < 0;
+}
+
 string ASTNodeBinaryExpr::gen_assign(GenCodeInfo *gen_code_info) {
 	stringstream ss;
+	ASTNode *outer_lvalue = gen_code_info->packed_lvalue;
+	gen_code_info->packed_lvalue = children[0];
+	gen_code_info->packed_mask.clear();
 	string code = dynamic_cast<ASTNodeExpression*>(children[0])->gen_code(gen_code_info);
+	gen_code_info->packed_lvalue = outer_lvalue;
+	// the left operand is an element of a packed array
+	string mask = gen_code_info->packed_mask;
+	// the register stored, and the i1 it was widened from for a boolean
+	int stored = -1, stored_bit = -1;
 	GenCodeInfo::ResultType left_result_type = gen_code_info->result_type;
 	GenCodeInfo::Result left_result = gen_code_info->result;
-	yy::location left_loc = gen_code_info->loc;
+	Location left_loc = gen_code_info->loc;
 	if (left_result_type == GenCodeInfo::NONE || left_result_type == GenCodeInfo::FUNCTION ||
 			(left_result_type == GenCodeInfo::SIMPLE && left_result.expr->type() == ASTNode::THIS)) {
 		ss << left_loc << " error: expression is not assignable" << endl;
@@ -1262,14 +3789,14 @@ string ASTNodeBinaryExpr::gen_assign(GenCodeInfo *gen_code_info) {
 		throw runtime_error(ss.str());
 	}
 	else if (left_result_type == GenCodeInfo::SIMPLE) { // ID
-		code += find_id(gen_code_info, dynamic_cast<ASTNodeID*>(left_result.expr)->getID(),
+		code += find_id(gen_code_info, dynamic_cast<ASTNodeID*>(left_result.expr),
 				left_result.regval.index, left_result.regval.id, &left_result.regval.type);
 	}
 
 	code += dynamic_cast<ASTNodeExpression*>(children[1])->gen_code(gen_code_info);
 	GenCodeInfo::ResultType right_result_type = gen_code_info->result_type;
 	GenCodeInfo::Result &right_result = gen_code_info->result;
-	yy::location &right_loc = gen_code_info->loc;
+	Location &right_loc = gen_code_info->loc;
 	stringstream result;
 	if (right_result_type == GenCodeInfo::NONE) {
 		ss << right_loc << " error: cannot use 'void' type as right operand of assignment" << endl;
@@ -1298,6 +3825,17 @@ string ASTNodeBinaryExpr::gen_assign(GenCodeInfo *gen_code_info) {
 					value = dynamic_cast<ASTNodeInteger*>(right_result.expr)->getValue();
 				else
 					value = dynamic_cast<ASTNodeBoolean*>(right_result.expr)->getValue();
+				if (!mask.empty()) {
+					result << gen_store_bit(gen_code_info, left_result.regval.index, mask,
+							value ? "true" : "false");
+					// the value of the assignment is the constant stored
+					if (children.size() < 3)
+						children.push_back(new ASTNodeBoolean(value != 0));
+					gen_code_info->result_type = GenCodeInfo::SIMPLE;
+					gen_code_info->result.expr = dynamic_cast<ASTNodeExpression*>(children[2]);
+					gen_code_info->loc = getLoc();
+					return code + result.str();
+				}
 				if (left_result.regval.type->variableType() == ASTNodeType::INTEGER)
 					result << "  store i32 " << value << ", i32* %";
 				else
@@ -1306,11 +3844,11 @@ string ASTNodeBinaryExpr::gen_assign(GenCodeInfo *gen_code_info) {
 					result << left_result.regval.index;
 				else
 					result << left_result.regval.id;
-				result << ", align 4" << endl;
+				result << ", align " << left_result.regval.type->getAlign() << endl;
 				goto ret;
 			}
 			else {
-				ss << loc << " error: assigning to '" << left_result.regval.type->getValue()
+				ss << getLoc() << " error: assigning to '" << left_result.regval.type->getValue()
 					<< "' from incompatible type '";
 				if (right_result.expr->type() == ASTNode::INTEGER)
 					ss << "integer";
@@ -1321,52 +3859,78 @@ string ASTNodeBinaryExpr::gen_assign(GenCodeInfo *gen_code_info) {
 			}
 		}
 		else { // ID
-			code += find_id(gen_code_info, dynamic_cast<ASTNodeID*>(right_result.expr)->getID(),
+			code += find_id(gen_code_info, dynamic_cast<ASTNodeID*>(right_result.expr),
 					right_result.regval.index, right_result.regval.id, &right_result.regval.type);
 		}
 	}
 
 	// case 2: rvalue is variable
-	if (left_result.regval.type->getValue() != right_result.regval.type->getValue()) {
+	if (left_result.regval.type != right_result.regval.type) {
 		if (!(	(left_result.regval.type->variableType() == ASTNodeType::INTEGER &&
 					right_result.regval.type->variableType() == ASTNodeType::BOOLEAN) ||
 				(left_result.regval.type->variableType() == ASTNodeType::BOOLEAN &&
 					right_result.regval.type->variableType() == ASTNodeType::INTEGER)))
 		{
-			ss << loc << " error: assigning to '" << left_result.regval.type->getValue()
+			ss << getLoc() << " error: assigning to '" << left_result.regval.type->getValue()
 				<< "' from incompatible type '" << right_result.regval.type->getValue() << "'" << endl;
 			throw runtime_error(ss.str());
 		}
 	}
-	else if (array_table.find(left_result.regval.type->getValue()) != array_table.end()) {
+	else if (left_result.regval.type->variableType() == ASTNodeType::ARRAY) {
 		ss << left_loc << " error: cannot assign to an array" << endl;
 		throw runtime_error(ss.str());
 	}
 
-	if (right_result_type == GenCodeInfo::SIMPLE || right_result_type == GenCodeInfo::POINTER) {
-		result << "  %" << gen_code_info->tempval_count << " = load "
-			<< right_result.regval.type->getTypeAsm(false) << "* %";
+	// a boolean copied from memory stays an i8, a computed one is an i1
+	bool isbyte;
+	isbyte = right_result_type == GenCodeInfo::SIMPLE || right_result_type == GenCodeInfo::POINTER;
+	if (isbyte) {
+		stringstream ptr;
+		ptr << "%";
 		if (right_result.regval.index >= 0)
-			result << right_result.regval.index;
+			ptr << right_result.regval.index;
 		else
-			result << right_result.regval.id;
-		result << ", align 4" << endl;
-		right_result.regval.index = gen_code_info->tempval_count++;
+			ptr << right_result.regval.id;
+		if (is_variable(right_result_type, right_result))
+			right_result.regval.index = gen_pure(gen_code_info, result,
+					load_inst(right_result.regval.type, ptr.str()));
+		else
+			right_result.regval.index = gen_load_memory(gen_code_info, result,
+					right_result.regval.type, ptr.str());
 	}
+	else if (right_result.regval.type->variableType() == ASTNodeType::BOOLEAN)
+		stored_bit = right_result.regval.index;
 	if (left_result.regval.type->variableType() == ASTNodeType::INTEGER) {
 		if (right_result.regval.type->variableType() == ASTNodeType::BOOLEAN) {
-			result << "  %" << gen_code_info->tempval_count << " = zext i8 %"
-				<< right_result.regval.index << " to i32" << endl;
-			right_result.regval.index = gen_code_info->tempval_count++;
+			right_result.regval.index = gen_pure(gen_code_info, result, string("zext ") +
+					(isbyte ? "i8 " : "i1 ") + reg(right_result.regval.index) + " to i32");
+			stored_bit = -1;
 		}
 		result << "  store i32 %" << right_result.regval.index << ", i32* %";
 	}
 	else if (left_result.regval.type->variableType() == ASTNodeType::BOOLEAN){
 		if (right_result.regval.type->variableType() == ASTNodeType::INTEGER) {
-			result << "  %" << gen_code_info->tempval_count++ << " = icmp ne i32 %"
+			result << "  %" << gen_code_info->tempval_count << " = icmp ne i32 %"
 				<< right_result.regval.index << ", 0" << endl;
+			right_result.regval.index = gen_code_info->tempval_count++;
+			stored_bit = right_result.regval.index;
+			isbyte = false;
+		}
+		if (!mask.empty()) {
+			if (isbyte) {
+				result << "  %" << gen_code_info->tempval_count << " = trunc i8 %"
+					<< right_result.regval.index << " to i1" << endl;
+				right_result.regval.index = gen_code_info->tempval_count++;
+			}
+			stringstream operand;
+			operand << "%" << right_result.regval.index;
+			result << gen_store_bit(gen_code_info, left_result.regval.index, mask, operand.str());
+			left_result.regval.index = right_result.regval.index;
+			goto ret;
+		}
+		if (!isbyte) {
 			result << "  %" << gen_code_info->tempval_count << " = zext i1 %"
-				<< gen_code_info->tempval_count - 1 << " to i8" << endl;
+				<< right_result.regval.index << " to i8" << endl;
 			right_result.regval.index = gen_code_info->tempval_count++;
 		}
 		result << "  store i8 %" << right_result.regval.index << ", i8* %";
@@ -1376,17 +3940,35 @@ string ASTNodeBinaryExpr::gen_assign(GenCodeInfo *gen_code_info) {
 			<< right_result.regval.index << ", "
 			<< right_result.regval.type->getTypeAsm(false) << "* %";
 	}
+	stored = right_result.regval.index;
 	if (left_result.regval.index >= 0)
 		result << left_result.regval.index;
 	else
 		result << left_result.regval.id;
-	result << ", align 4" << endl;
+	result << ", align " << left_result.regval.type->getAlign() << endl;
 
 ret:
-	gen_code_info->result_type = GenCodeInfo::POINTER;
+	if (mask.empty()) {
+		// later loads of the left operand give the value stored
+		string ptr = left_result.regval.index >= 0 ? reg(left_result.regval.index) : "%" + left_result.regval.id;
+		GenCodeInfo::Available &available = block_values(gen_code_info);
+		bool variable = is_variable(left_result_type, left_result);
+		if (!variable)
+			forget_memory(gen_code_info, ptr);
+		forget_load(gen_code_info, ptr);
+		if (stored >= 0) {
+			(variable ? available.values : available.memory)[load_inst(left_result.regval.type, ptr)] = stored;
+			if (stored_bit >= 0)
+				available.values["trunc i8 " + reg(stored) + " to i1"] = stored_bit;
+		}
+	}
+	else
+		forget_memory(gen_code_info);
+	// a packed element gives the i1 stored, not a pointer
+	gen_code_info->result_type = mask.empty() ? GenCodeInfo::POINTER : GenCodeInfo::VALUE;
 	gen_code_info->result = left_result;
-	gen_code_info->result.regval.islvalue = true;
-	gen_code_info->loc = loc;
+	gen_code_info->result.regval.islvalue = mask.empty();
+	gen_code_info->loc = getLoc();
 	return code + result.str();
 }
 
@@ -1394,7 +3976,7 @@ string ASTNodeBinaryExpr::gen_compute_load(GenCodeInfo *gen_code_info, bool &isc
 	stringstream ss, ret;
 	GenCodeInfo::ResultType &result_type = gen_code_info->result_type;
 	GenCodeInfo::Result &result = gen_code_info->result;
-	yy::location &loc = gen_code_info->loc;
+	Location &loc = gen_code_info->loc;
 	if (result_type == GenCodeInfo::NONE) {
 		ss << loc << " error: invalid operands to binary operator '"
 			<< op << "' (" << (left ? "left" : "right") << " operand is 'void')" << endl;
@@ -1409,22 +3991,14 @@ string ASTNodeBinaryExpr::gen_compute_load(GenCodeInfo *gen_code_info, bool &isc
 load_value:
 		if (result.regval.type->variableType() == ASTNodeType::INTEGER ||
 				result.regval.type->variableType() == ASTNodeType::BOOLEAN) {
-			if (result_type == GenCodeInfo::POINTER) {
-				ret << "  %" << gen_code_info->tempval_count << " = load "
-					<< result.regval.type->getAsm() << "* %";
-				if (result.regval.index >= 0)
-					ret << result.regval.index;
-				else
-					ret << result.regval.id;
-				ret << ", align 4" << endl;
-				result.regval.index = gen_code_info->tempval_count++;
-			}
+			if (result_type == GenCodeInfo::POINTER)
+				ret << gen_load(gen_code_info, result);
 		}
 		else {
 			string type_name = result.regval.type->getValue();
-			if (array_table.find(type_name) != array_table.end())
+			if (result.regval.type->variableType() == ASTNodeType::ARRAY)
 				type_name = "array type '" + type_name + "'";
-			else if (class_table.find(type_name) != class_table.end())
+			else if (result.regval.type->variableType() == ASTNodeType::CLASS)
 				type_name = "class type '" + type_name + "'";
 			ss << loc << " error: invalid operands to binary operator '" << op
 				<< "' (" << (left ? "left" : "right") << " operand is " << type_name << ")" << endl;
@@ -1453,15 +4027,147 @@ load_value:
 			value = dynamic_cast<ASTNodeBoolean*>(result.expr)->getValue();
 		}
 		else {
-			ret << find_id(gen_code_info, dynamic_cast<ASTNodeID*>(result.expr)->getID(),
-					result.regval.index, result.regval.id, &result.regval.type);
-			result_type = GenCodeInfo::POINTER;
+			ret << load_id(gen_code_info, result.expr, result.regval.index, &result.regval.id, &result.regval.type);
+			result_type = GenCodeInfo::VALUE;
 			goto load_value;
 		}
 	}
 	return ret.str();
 }
 
+// k if value is 2^k, -1 otherwise
+static int exact_log2(unsigned value) {
+	if (value == 0 || (value & (value - 1)) != 0)
+		return -1;
+	int k = 0;
+	while (value >>= 1)
+		k++;
+	return k;
+}
+
+// the multiplier M and shift s such that n / d is the high word of M * n
+// shifted by s and rounded towards 0, from Hacker's Delight 10-1; 2 <= |d|
+static void magic_divisor(int d, long long &multiplier, int &shift) {
+	const unsigned two31 = 0x80000000u;
+	unsigned ad = d < 0 ? -(unsigned)d : d;
+	unsigned t = two31 + ((unsigned)d >> 31);
+	unsigned anc = t - 1 - t % ad;
+	unsigned q1 = two31 / anc, r1 = two31 - q1 * anc;
+	unsigned q2 = two31 / ad, r2 = two31 - q2 * ad;
+	unsigned delta;
+	int p = 31;
+	do {
+		p++;
+		q1 = 2 * q1;
+		r1 = 2 * r1;
+		if (r1 >= anc) {
+			q1++;
+			r1 -= anc;
+		}
+		q2 = 2 * q2;
+		r2 = 2 * r2;
+		if (r2 >= ad) {
+			q2++;
+			r2 -= ad;
+		}
+		delta = ad - r2;
+	} while (q1 < delta || (q1 == delta && r1 == 0));
+	int m = q2 + 1;
+	if (d < 0)
+		m = -m;
+	shift = p - 32;
+	// adding or subtracting n after the multiply is folded into a 64-bit multiplier
+	multiplier = m;
+	if (d > 0 && m < 0)
+		multiplier += 1LL << 32;
+	if (d < 0 && m > 0)
+		multiplier -= 1LL << 32;
+}
+
+// emits %operand / value rounded towards 0 without a sdiv, 2 <= |value|
+static int gen_div_const(GenCodeInfo* gen_code_info, stringstream &result, int operand, int value) {
+	unsigned magnitude = value < 0 ? -(unsigned)value : value;
+	int k = exact_log2(magnitude);
+	int quotient;
+	if (k > 0) {
+		// a negative dividend is biased by 2^k - 1 so that the shift rounds towards 0
+		int sign = gen_pure(gen_code_info, result, "ashr i32 " + reg(operand) + ", 31");
+		int bias = gen_pure(gen_code_info, result, "lshr i32 " + reg(sign) + ", " + imm(32 - k));
+		int biased = gen_pure(gen_code_info, result, "add i32 " + reg(operand) + ", " + reg(bias));
+		quotient = gen_pure(gen_code_info, result, "ashr i32 " + reg(biased) + ", " + imm(k));
+	}
+	else {
+		long long multiplier;
+		int shift;
+		magic_divisor(value, multiplier, shift);
+		int wide = gen_pure(gen_code_info, result, "sext i32 " + reg(operand) + " to i64");
+		int product = gen_pure(gen_code_info, result, "mul i64 " + reg(wide) + ", " + imm(multiplier));
+		int high = gen_pure(gen_code_info, result, "ashr i64 " + reg(product) + ", " + imm(32 + shift));
+		int estimate = gen_pure(gen_code_info, result, "trunc i64 " + reg(high) + " to i32");
+		// the estimate is one below the quotient when negative
+		int sign = gen_pure(gen_code_info, result, "lshr i32 " + reg(estimate) + ", 31");
+		return gen_pure(gen_code_info, result, "add i32 " + reg(estimate) + ", " + reg(sign));
+	}
+	if (value < 0)
+		quotient = gen_pure(gen_code_info, result, "sub i32 0, " + reg(quotient));
+	return quotient;
+}
+
+// lowers %operand op value, for a constant operand value of '*', '/' or '%',
+// to shifts, adds and multiplies; gives -1 if it's not cheaper
+static int gen_const_arith(GenCodeInfo* gen_code_info, stringstream &result,
+		const string &op, int operand, int value) {
+	if (op == "*") {
+		if ((value >= -1 && value <= 1) || value == INT_MIN)
+			return -1;
+		unsigned magnitude = value < 0 ? -(unsigned)value : value;
+		int k = exact_log2(magnitude);
+		if (k > 0) {
+			int shifted = gen_pure(gen_code_info, result, "shl i32 " + reg(operand) + ", " + imm(k));
+			return value > 0 ? shifted : gen_pure(gen_code_info, result, "sub i32 0, " + reg(shifted));
+		}
+		if (value < 0)
+			return -1;
+		// 2^a + 2^b or 2^a - 2^b
+		unsigned low = magnitude & -magnitude;
+		int a, b = exact_log2(low);
+		string inst;
+		if ((a = exact_log2(magnitude - low)) > 0)
+			inst = "add i32";
+		else if ((a = exact_log2(magnitude + low)) > 0 && a < 32)
+			inst = "sub i32";
+		else
+			return -1;
+		int high = gen_pure(gen_code_info, result, "shl i32 " + reg(operand) + ", " + imm(a));
+		int other = operand;
+		if (b > 0)
+			other = gen_pure(gen_code_info, result, "shl i32 " + reg(operand) + ", " + imm(b));
+		return gen_pure(gen_code_info, result, inst + " " + reg(high) + ", " + reg(other));
+	}
+	if ((value >= -1 && value <= 1) || value == INT_MIN)
+		return -1;
+	if (op == "/")
+		return gen_div_const(gen_code_info, result, operand, value);
+	else if (op == "%") {
+		// the remainder has the sign of the dividend, that of value doesn't matter
+		unsigned magnitude = value < 0 ? -(unsigned)value : value;
+		int k = exact_log2(magnitude);
+		int multiple;
+		if (k > 0) {
+			int sign = gen_pure(gen_code_info, result, "ashr i32 " + reg(operand) + ", 31");
+			int bias = gen_pure(gen_code_info, result, "lshr i32 " + reg(sign) + ", " + imm(32 - k));
+			int biased = gen_pure(gen_code_info, result, "add i32 " + reg(operand) + ", " + reg(bias));
+			multiple = gen_pure(gen_code_info, result, "and i32 " + reg(biased) + ", " + imm(-(long long)magnitude));
+		}
+		else {
+			int quotient = gen_div_const(gen_code_info, result, operand, value);
+			multiple = gen_pure(gen_code_info, result, "mul i32 " + reg(quotient) + ", " + imm(value));
+		}
+		return gen_pure(gen_code_info, result, "sub i32 " + reg(operand) + ", " + reg(multiple));
+	}
+	return -1;
+}
+
 string ASTNodeBinaryExpr::gen_compute(GenCodeInfo *gen_code_info) {
 	stringstream ss, result;
 	string lcode = dynamic_cast<ASTNodeExpression*>(children[0])->gen_code(gen_code_info);
@@ -1470,13 +4176,20 @@ string ASTNodeBinaryExpr::gen_compute(GenCodeInfo *gen_code_info) {
 	int left_value;
 	lcode += gen_compute_load(gen_code_info, left_isconstant, left_isbool, left_value, true);
 	GenCodeInfo::Result left_result = gen_code_info->result;
-	
-	int left_block, right_block, left_tempval;
+	// a folded result drops the code of the right operand, and the numbers it took
+	int tempval_count = gen_code_info->tempval_count;
+	int current_block = gen_code_info->current_block;
+	GenCodeInfo::Available available = gen_code_info->available;
+
+	// a boolean operand is already an i1 and can be branched on directly
+	int left_block, right_block, left_cond;
 	if ((op == "or" || op == "and") && !left_isconstant) {
 		left_block = gen_code_info->current_block;
-		left_tempval = gen_code_info->tempval_count;
-		gen_code_info->tempval_count += 2;
-		right_block = gen_code_info->current_block = left_tempval + 1;
+		if (left_result.regval.type->variableType() == ASTNodeType::BOOLEAN)
+			left_cond = left_result.regval.index;
+		else
+			left_cond = gen_code_info->tempval_count++;
+		right_block = gen_code_info->current_block = gen_code_info->tempval_count++;
 	}
 
 	string rcode = dynamic_cast<ASTNodeExpression*>(children[1])->gen_code(gen_code_info);
@@ -1508,25 +4221,26 @@ string ASTNodeBinaryExpr::gen_compute(GenCodeInfo *gen_code_info) {
 				}
 				else {
 					if (right_result.regval.type->variableType() == ASTNodeType::INTEGER) {
-						result << "  %" << gen_code_info->tempval_count++ << " = icmp ne i32 %"
+						result << "  %" << gen_code_info->tempval_count << " = icmp ne i32 %"
 							<< right_result.regval.index << ", 0" << endl;
-						result << "  %" << gen_code_info->tempval_count << " = zext i1 %"
-							<< gen_code_info->tempval_count - 1 << " to i8" << endl;
 						right_result.regval.index = gen_code_info->tempval_count++;
 					}
-					right_result.regval.type = new ASTNodeType(ASTNodeType::BOOLEAN);
-					children.push_back(right_result.regval.type);
+					right_result.regval.type = Type::get(ASTNodeType::BOOLEAN);
 					goto ret_regval;
 				}
 			}
 		}
 		else {
 			stringstream lresult;
-			int end_block;
+			int end_block, right_cond;
 			if (!right_isconstant) {
-				result << "  %" << gen_code_info->tempval_count++ << " = icmp ne "
-					<< right_result.regval.type->getAsm() << " %"
-					<< right_result.regval.index << ", 0" << endl;
+				if (right_result.regval.type->variableType() == ASTNodeType::BOOLEAN)
+					right_cond = right_result.regval.index;
+				else {
+					result << "  %" << gen_code_info->tempval_count << " = icmp ne i32 %"
+						<< right_result.regval.index << ", 0" << endl;
+					right_cond = gen_code_info->tempval_count++;
+				}
 			}
 			result << "  br label %" << gen_code_info->tempval_count << endl;
 			end_block = gen_code_info->tempval_count++;
@@ -1549,14 +4263,13 @@ string ASTNodeBinaryExpr::gen_compute(GenCodeInfo *gen_code_info) {
 					result << "false";
 			}
 			else
-				result << "%" << end_block - 1;
+				result << "%" << right_cond;
 			result << ", %" << gen_code_info->current_block << " ]" << endl;
-			result << "  %" << gen_code_info->tempval_count << " = zext i1 %"
-				<< gen_code_info->tempval_count - 1 << " to i8" << endl;
 
-			lresult << "  %" << left_tempval << " = icmp ne " << left_result.regval.type->getAsm()
-				<< " %" << left_result.regval.index << ", 0" << endl;
-			lresult << "  br i1 %" << left_tempval << ", label %";
+			if (left_result.regval.type->variableType() == ASTNodeType::INTEGER)
+				lresult << "  %" << left_cond << " = icmp ne i32 %"
+					<< left_result.regval.index << ", 0" << endl;
+			lresult << "  br i1 %" << left_cond << ", label %";
 			if (op == "or")
 				lresult << end_block << ", label %" << right_block << endl;
 			else
@@ -1570,9 +4283,8 @@ string ASTNodeBinaryExpr::gen_compute(GenCodeInfo *gen_code_info) {
 			lcode += lresult.str();
 
 			gen_code_info->current_block = end_block;
-			right_result.regval.index = gen_code_info->tempval_count++;
-			right_result.regval.type = new ASTNodeType(ASTNodeType::BOOLEAN);
-			children.push_back(right_result.regval.type);
+			right_result.regval.index = gen_code_info->tempval_count - 1;
+			right_result.regval.type = Type::get(ASTNodeType::BOOLEAN);
 			goto ret_regval;
 		}
 	}
@@ -1620,83 +4332,89 @@ string ASTNodeBinaryExpr::gen_compute(GenCodeInfo *gen_code_info) {
 				children.push_back(new ASTNodeBoolean(bool(left_value > right_value)));
 			goto ret_constant;
 		}
-		if (!left_isconstant && left_result.regval.type->variableType() == ASTNodeType::BOOLEAN) {
-			result << "  %" << gen_code_info->tempval_count << " = zext i8 %"
-				<< left_result.regval.index << " to i32" << endl;
-			left_result.regval.index = gen_code_info->tempval_count++;
-		}
-		if (!right_isconstant && right_result.regval.type->variableType() == ASTNodeType::BOOLEAN) {
-			result << "  %" << gen_code_info->tempval_count << " = zext i8 %"
-				<< right_result.regval.index << " to i32" << endl;
-			right_result.regval.index = gen_code_info->tempval_count++;
+		if (!left_isconstant && left_result.regval.type->variableType() == ASTNodeType::BOOLEAN)
+			left_result.regval.index = gen_pure(gen_code_info, result,
+				"zext i1 " + reg(left_result.regval.index) + " to i32");
+		if (!right_isconstant && right_result.regval.type->variableType() == ASTNodeType::BOOLEAN)
+			right_result.regval.index = gen_pure(gen_code_info, result,
+				"zext i1 " + reg(right_result.regval.index) + " to i32");
+
+		if ((op == "*" || op == "/" || op == "%") && right_isconstant != left_isconstant &&
+				(right_isconstant || op == "*")) {
+			int index = gen_const_arith(gen_code_info, result, op,
+				right_isconstant ? left_result.regval.index : right_result.regval.index,
+				right_isconstant ? right_value : left_value);
+			if (index >= 0) {
+				right_result.regval.type = Type::get(ASTNodeType::INTEGER);
+				right_result.regval.index = index;
+				goto ret_regval;
+			}
 		}
 
-		result << "  %" << gen_code_info->tempval_count;
+		stringstream inst;
 		if (op == "|")
-			result << " = or i32 ";
+			inst << "or i32 ";
 		else if (op == "^")
-			result << " = xor i32 ";
+			inst << "xor i32 ";
 		else if (op == "&")
-			result << " = and i32 ";
+			inst << "and i32 ";
 		else if (op == "<<")
-			result << " = shl i32 ";
+			inst << "shl i32 ";
 		else if (op == ">>")
-			result << " = ashr i32 ";
+			inst << "ashr i32 ";
 		else if (op == "+")
-			result << " = add nsw i32 ";
+			inst << "add i32 ";
 		else if (op == "-")
-			result << " = sub nsw i32 ";
+			inst << "sub i32 ";
 		else if (op == "*")
-			result << " = mul nsw i32 ";
+			inst << "mul i32 ";
 		else if (op == "/")
-			result << " = sdiv i32 ";
+			inst << "sdiv i32 ";
 		else if (op == "%")
-			result << " = srem i32 ";
+			inst << "srem i32 ";
 		else if (op == "==")
-			result << " = icmp eq i32 ";
+			inst << "icmp eq i32 ";
 		else if (op == "!=")
-			result << " = icmp ne i32 ";
+			inst << "icmp ne i32 ";
 		else if (op == "<=")
-			result << " = icmp sle i32 ";
+			inst << "icmp sle i32 ";
 		else if (op == ">=")
-			result << " = icmp sge i32 ";
+			inst << "icmp sge i32 ";
 		else if (op == "<")
-			result << " = icmp slt i32 ";
+			inst << "icmp slt i32 ";
 		else if (op == ">")
-			result << " = icmp sgt i32 ";
+			inst << "icmp sgt i32 ";
 		if (left_isconstant)
-			result << left_value;
+			inst << left_value;
 		else
-			result << "%" << left_result.regval.index;
-		result << ", ";
+			inst << "%" << left_result.regval.index;
+		inst << ", ";
 		if (right_isconstant)
-			result << right_value;
+			inst << right_value;
 		else
-			result << "%" << right_result.regval.index;
-		result << endl;
-		if (op == "==" || op == "!=" || op == "<=" || op == ">=" || op == "<" || op == ">") {
-			result << "  %" << gen_code_info->tempval_count + 1 << " = zext i1 %"
-				<< gen_code_info->tempval_count << " to i8" << endl;
-			gen_code_info->tempval_count++;
-			right_result.regval.type = new ASTNodeType(ASTNodeType::BOOLEAN);
-		}
+			inst << "%" << right_result.regval.index;
+		int index = gen_pure(gen_code_info, result, inst.str());
+		if (op == "==" || op == "!=" || op == "<=" || op == ">=" || op == "<" || op == ">")
+			right_result.regval.type = Type::get(ASTNodeType::BOOLEAN);
 		else
-			right_result.regval.type = new ASTNodeType(ASTNodeType::INTEGER);
-		children.push_back(right_result.regval.type);
-		right_result.regval.index = gen_code_info->tempval_count++;
+			right_result.regval.type = Type::get(ASTNodeType::INTEGER);
+		right_result.regval.index = index;
 		goto ret_regval;
 	}
 
 ret_regval:
 	gen_code_info->result_type = GenCodeInfo::VALUE;
 	gen_code_info->result.regval.islvalue = false;
-	gen_code_info->loc = loc;
+	gen_code_info->loc = getLoc();
 	return lcode + rcode + result.str();
 
 ret_constant:
+	gen_code_info->tempval_count = tempval_count;
+	gen_code_info->current_block = current_block;
+	gen_code_info->available = available;
 	gen_code_info->result_type = GenCodeInfo::SIMPLE;
 	gen_code_info->result.expr = dynamic_cast<ASTNodeExpression*>(children[2]);
-	gen_code_info->loc = loc;
+	gen_code_info->loc = getLoc();
 	return lcode;
 }
 
@@ -1714,32 +4432,27 @@ string ASTNodeMethodInvocation::gen_code(GenCodeInfo* gen_code_info) {
 	GenCodeInfo::Result func_result;
 	string func_name;
 	map<string, pair<int, ASTNodeType*>>* params;
-	ASTNodeType* return_type;
-	stringstream pre_call;
+	Type* return_type;
 	if (children[0]->type() == ASTNode::IDENTIFIER) {
 		func_name = dynamic_cast<ASTNodeID*>(children[0])->getID();
-		if (g_func_table.find(func_name) == g_func_table.end()) {
-			if (gen_code_info->func_table &&
-					(gen_code_info->func_table->find(func_name) != gen_code_info->func_table->end())) {
-				pre_call << "  %" << gen_code_info->tempval_count << " = load %class."
-					<< gen_code_info->class_id << "** %1, align 4" << endl;
-				code = pre_call.str();
-				func_result.func.this_index = gen_code_info->tempval_count++;
-				func_result.func.class_id = gen_code_info->class_id;
-				func_result.func.func = (*gen_code_info->func_table)[func_name];
-				params = func_result.func.func->getParams();
-				return_type = dynamic_cast<ASTNodeType*>(func_result.func.func->getChildren()[3]);
-			}
-			else {
-				ss << children[0]->getLoc() << " error: function '" << func_name
-					<< "' is not declared" << endl;
-				throw runtime_error(ss.str());
-			}
+		const Binding &binding = dynamic_cast<ASTNodeID*>(children[0])->getBinding();
+		if (binding.kind == Binding::METHOD) {
+			func_result.func.this_index = -1;
+			func_result.func.this_id = "this";
+			func_result.func.class_id = gen_code_info->class_id;
+			func_result.func.func = binding.func;
+			params = binding.func->getParams();
+			return_type = dynamic_cast<ASTNodeType*>(binding.func->getChildren()[3])->getType();
 		}
-		else {
+		else if (binding.kind == Binding::FUNCTION) {
 			isglobal = true;
-			params = g_func_table[func_name]->getParams();
-			return_type = dynamic_cast<ASTNodeType*>(g_func_table[func_name]->getChildren()[3]);
+			params = binding.func->getParams();
+			return_type = dynamic_cast<ASTNodeType*>(binding.func->getChildren()[3])->getType();
+		}
+		else {
+			ss << children[0]->getLoc() << " error: function '" << func_name
+				<< "' is not declared" << endl;
+			throw runtime_error(ss.str());
 		}
 	}
 	else {
@@ -1751,20 +4464,30 @@ string ASTNodeMethodInvocation::gen_code(GenCodeInfo* gen_code_info) {
 		func_result = gen_code_info->result;
 		func_name = dynamic_cast<ASTNodeID*>(func_result.func.func->getChildren()[0])->getID();
 		params = func_result.func.func->getParams();
-		return_type = dynamic_cast<ASTNodeType*>(func_result.func.func->getChildren()[3]);
+		return_type = dynamic_cast<ASTNodeType*>(func_result.func.func->getChildren()[3])->getType();
 	}
 
 	stringstream call;
-	call << "call " << return_type->getTypeAsm(false) << " @";
+	// a returned class is written to a temporary of the caller
+	string sret_id;
+	if (return_type->variableType() == ASTNodeType::CLASS)
+		sret_id = gen_entry_alloca(gen_code_info, return_type);
+	call << "call " << (sret_id.empty() ? return_type->getRegAsm() : "void") << " @";
 	if (isglobal) {
 		if (func_name == "main")
 			call << "...main(";
 		else
 			call << func_name << "(";
 	}
-	else {
-		call << "class." << func_result.func.class_id << "." << func_name << "(%class."
-			<< func_result.func.class_id << "* %";
+	else
+		call << "class." << func_result.func.class_id << "." << func_name << "(";
+	if (!sret_id.empty()) {
+		call << return_type->getAsm() << "* sret %" << sret_id;
+		if (!isglobal || !params->empty())
+			call << ", ";
+	}
+	if (!isglobal) {
+		call << "%class." << func_result.func.class_id << "* %";
 		if (func_result.func.this_index >= 0)
 			call << func_result.func.this_index;
 		else
@@ -1773,21 +4496,21 @@ string ASTNodeMethodInvocation::gen_code(GenCodeInfo* gen_code_info) {
 			call << ", ";
 	}
 	
-	vector<ASTNode*>& param_list = children[1]->getChildren();
+	ChildList param_list = children[1]->getChildren();
 	if (param_list.size() != params->size()) {
-		ss << loc << " error: function requires " << params->size() << " arguments, but "
+		ss << getLoc() << " error: function requires " << params->size() << " arguments, but "
 			<< param_list.size() << " was provided" << endl;
 		throw runtime_error(ss.str());
 	}
-	vector<ASTNodeType*> param_type(params->size());
+	vector<Type*> param_type(params->size());
 	for (auto iter : *params)
-		param_type[iter.second.first] = iter.second.second;
+		param_type[iter.second.first] = iter.second.second->getType();
 
 	for (int i = 0; i < param_list.size(); ++i) {
 		stringstream code_add;
 		if (i != 0)
 			call << ", ";
-		ASTNodeType *type = param_type[i];
+		Type *type = param_type[i];
 		code += dynamic_cast<ASTNodeExpression*>(param_list[i])->gen_code(gen_code_info);
 		GenCodeInfo::Result &result = gen_code_info->result;
 		if (gen_code_info->result_type == GenCodeInfo::NONE) {
@@ -1801,29 +4524,20 @@ string ASTNodeMethodInvocation::gen_code(GenCodeInfo* gen_code_info) {
 		else if (gen_code_info->result_type == GenCodeInfo::POINTER ||
 				gen_code_info->result_type == GenCodeInfo::VALUE) {
 			if (gen_code_info->result_type == GenCodeInfo::POINTER &&
-					array_table.find(result.regval.type->getValue()) == array_table.end()) {
-				code_add << "  %" << gen_code_info->tempval_count << " = load "
-					<< result.regval.type->getTypeAsm(false) << "* %";
-				if (result.regval.index >= 0)
-					code_add << result.regval.index;
-				else
-					code_add << result.regval.id;
-				code_add << ", align 4" << endl;
-				result.regval.index = gen_code_info->tempval_count++;
-			}
+					result.regval.type->variableType() != ASTNodeType::ARRAY &&
+					result.regval.type->variableType() != ASTNodeType::CLASS)
+				code_add << gen_load(gen_code_info, result);
 call_variable:
-			if (result.regval.type->getValue() != type->getValue()) {
+			if (result.regval.type != type) {
 				if (result.regval.type->variableType() == ASTNodeType::INTEGER &&
 						type->variableType() == ASTNodeType::BOOLEAN) {
-					code_add << "  %" << gen_code_info->tempval_count++ << " = icmp ne i32 %"
+					code_add << "  %" << gen_code_info->tempval_count << " = icmp ne i32 %"
 						<< result.regval.index << ", 0" << endl;
-					code_add << "  %" << gen_code_info->tempval_count << " = zext i1 %"
-						<< gen_code_info->tempval_count - 1 << " to i8" << endl;
 					result.regval.index = gen_code_info->tempval_count++;
 				}
 				else if (result.regval.type->variableType() == ASTNodeType::BOOLEAN &&
 						type->variableType() == ASTNodeType::INTEGER) {
-					code_add << "  %" << gen_code_info->tempval_count << " = zext i8 %"
+					code_add << "  %" << gen_code_info->tempval_count << " = zext i1 %"
 						<< result.regval.index << " to i32" << endl;
 					result.regval.index = gen_code_info->tempval_count++;
 				}
@@ -1834,7 +4548,10 @@ call_variable:
 				}
 			}
 			code += code_add.str();
-			call << type->getTypeAsm(true) << " %";
+			call << type->getRegAsm();
+			if (type->variableType() == ASTNodeType::CLASS)
+				call << "*";
+			call << " %";
 			if (result.regval.index >= 0)
 				call << result.regval.index;
 			else
@@ -1860,7 +4577,7 @@ call_variable:
 				if (type->variableType() == ASTNodeType::INTEGER)
 					call << "i32 " << value;
 				else if (type->variableType() == ASTNodeType::BOOLEAN)
-					call << "i8 " << bool(value);
+					call << "i1 " << (value ? "true" : "false");
 				else {
 					ss << gen_code_info->loc << " error: argument type not match, expected type '"
 						<< type->getValue() << "'" << endl;
@@ -1868,17 +4585,31 @@ call_variable:
 				}
 			}
 			else { //ID
-				code += load_id(gen_code_info, expr, result.regval.index, &result.regval.id, &result.regval.type);
+				ASTNodeID *id_node = dynamic_cast<ASTNodeID*>(expr);
+				if (id_node->getBinding().kind != Binding::UNRESOLVED &&
+						id_node->getBinding().type->variableType() == ASTNodeType::CLASS)
+					code += find_id(gen_code_info, id_node, result.regval.index, result.regval.id, &result.regval.type);
+				else
+					code += load_id(gen_code_info, expr, result.regval.index, &result.regval.id, &result.regval.type);
 				goto call_variable;
 			}
 		}
 	}
 	call << ")" << endl;
+	// the callee may store to any memory but the slots of variables
+	forget_memory(gen_code_info);
 
 	if (return_type->variableType() == ASTNodeType::VOID) {
 		code += "  " + call.str();
 		gen_code_info->result_type = GenCodeInfo::NONE;
 	}
+	else if (!sret_id.empty()) {
+		code += "  " + call.str();
+		gen_code_info->result_type = GenCodeInfo::POINTER;
+		gen_code_info->result.regval.index = -1;
+		gen_code_info->result.regval.id = sret_id;
+		gen_code_info->result.regval.type = return_type;
+	}
 	else {
 		stringstream sss;
 		sss << "  %" << gen_code_info->tempval_count << " = ";
@@ -1889,7 +4620,7 @@ call_variable:
 	}
 
 	gen_code_info->result.regval.islvalue = false;
-	gen_code_info->loc = loc;
+	gen_code_info->loc = getLoc();
 	return code;
 }
 
@@ -1901,58 +4632,51 @@ string ASTNodePrintStmt::gen_simple(GenCodeInfo* gen_code_info) {
 	if (!expr) {
 		throw runtime_error("panic: unexpected code path, BUG in code!\n");
 	}
-	if (expr->type() == ASTNode::IDENTIFIER) {
+	if (expr->type() == ASTNode::IDENTIFIER &&
+			dynamic_cast<ASTNodeID*>(expr)->getBinding().kind != Binding::UNRESOLVED &&
+			(dynamic_cast<ASTNodeID*>(expr)->getBinding().type->variableType() == ASTNodeType::ARRAY ||
+			dynamic_cast<ASTNodeID*>(expr)->getBinding().type->variableType() == ASTNodeType::CLASS)) {
 		int index;
-		ASTNodeType *type;
-		result << load_id(gen_code_info, expr, index, NULL, &type);
-		if (type->variableType() == ASTNodeType::INTEGER ||
-				type->variableType() == ASTNodeType::BOOLEAN) {
-			if (type->variableType() == ASTNodeType::BOOLEAN) {
-				result << "  %" << gen_code_info->tempval_count << " = zext i8 %"
-					<< index << " to i32" << endl;
-				index = gen_code_info->tempval_count++;
-			}
-			result << "  %" << gen_code_info->tempval_count++
-				<< " = call i32 (i8*, ...)* @printf(i8* getelementptr inbounds (["
-				<< 3 <<" x i8]* @.str" << str_table["%d"] <<", i32 0, i32 0), i32 %"
-				<< index << ")" << endl;
-		}
-		else if (array_table.find(type->getValue()) != array_table.end()) {
-			ss << gen_code_info->loc << " error[TODO]: we don't support printing array" << endl;
-			throw runtime_error(ss.str());
-		}
-		else if (class_table.find(type->getValue()) != class_table.end()) {
-			ss << gen_code_info->loc << " error[TODO]: we don't support printing class" << endl;
-			throw runtime_error(ss.str());
+		string index_id;
+		Type *type;
+		result << find_id(gen_code_info, dynamic_cast<ASTNodeID*>(expr), index, index_id, &type);
+		// array parameters are passed by reference
+		if (dynamic_cast<ASTNodeID*>(expr)->getBinding().kind == Binding::PARAM &&
+				type->variableType() == ASTNodeType::ARRAY) {
+			result << "  %" << gen_code_info->tempval_count << " = load "
+				<< type->getAsm() << "** %" << index << ", align 8" << endl;
+			index = gen_code_info->tempval_count++;
 		}
+		result << gen_print_aggregate(type, index, index_id);
+	}
+	else if (expr->type() == ASTNode::IDENTIFIER) {
+		int index;
+		Type *type;
+		result << load_id(gen_code_info, expr, index, NULL, &type);
+		if (type->variableType() == ASTNodeType::INTEGER)
+			result << "  call void @dragon_print_i32(i32 %" << index << ")" << endl;
+		else if (type->variableType() == ASTNodeType::BOOLEAN)
+			result << "  call void @dragon_print_bool(i1 %" << index << ")" << endl;
 		else {
 			ss << gen_code_info->loc << " panic: unexpected code path, BUG in code!" << endl;
 			throw runtime_error(ss.str());
 		}
 	}
 	else if (expr->type() == ASTNode::THIS) {
-		if (gen_code_info->class_id.empty())
+		if (gen_code_info->class_id.empty()) {
 			ss << gen_code_info->loc << " error: invalid use of 'this' in non-member function" << endl;
-		else
-			ss << gen_code_info->loc << " error[TODO]: we don't support printing class" << endl;
-		throw runtime_error(ss.str());
+			throw runtime_error(ss.str());
+		}
+		result << gen_print_aggregate(gen_code_info->this_type, -1, "this");
 	}
 	else if (expr->type() == ASTNode::INTEGER || expr->type() == ASTNode::BOOLEAN) {
+		// a folded constant expression, literal arguments never get here
 		int value;
 		if (expr->type() == ASTNode::INTEGER)
 			value = dynamic_cast<ASTNodeInteger*>(expr)->getValue();
 		else
 			value = dynamic_cast<ASTNodeBoolean*>(expr)->getValue();
-		result << "  %" << gen_code_info->tempval_count++
-			<< " = call i32 (i8*, ...)* @printf(i8* getelementptr inbounds (["
-			<< 3 <<" x i8]* @.str" << str_table["%d"] <<", i32 0, i32 0), i32 "
-			<< value << ")" << endl;
-	}
-	else if (expr->type() == ASTNode::STRING) {
-		string str = dynamic_cast<ASTNodeString*>(expr)->getValue();
-		result << "  %" << gen_code_info->tempval_count++
-			<< " = call i32 (i8*, ...)* @printf(i8* getelementptr inbounds (["
-			<< str.size() + 1 <<" x i8]* @.str" << str_table[str] <<", i32 0, i32 0))" << endl;
+		result << "  call void @dragon_print_i32(i32 " << value << ")" << endl;
 	}
 	else {
 		ss << gen_code_info->loc << " panic: unexpected code path, BUG in code!" << endl;
@@ -1965,25 +4689,36 @@ string ASTNodePrintStmt::gen_composed(GenCodeInfo* gen_code_info) {
 	stringstream ss, result;
 	int index = gen_code_info->result.regval.index;
 	string id = gen_code_info->result.regval.id;
+	Type *type = gen_code_info->result.regval.type;
+	if (type->variableType() == ASTNodeType::ARRAY || type->variableType() == ASTNodeType::CLASS) {
+		if (gen_code_info->result_type == GenCodeInfo::VALUE) {
+			// a class returned by value, intermediate value will always be anonymous
+			result << "  %" << gen_code_info->tempval_count << " = alloca "
+				<< type->getAsm() << ", align " << type->getAlign() << endl;
+			result << "  store " << type->getAsm() << " %" << index << ", "
+				<< type->getAsm() << "* %" << gen_code_info->tempval_count << ", align " << type->getAlign() << endl;
+			index = gen_code_info->tempval_count++;
+		}
+		return result.str() + gen_print_aggregate(type, index, id);
+	}
 	if (gen_code_info->result_type == GenCodeInfo::POINTER) {
-		result << "  %" << gen_code_info->tempval_count << " = load "
-			<< gen_code_info->result.regval.type->getAsm() << "* %";
-		if (index >= 0)
-			result << index;
-		else
-			result << id;
-		result << ", align 4" << endl;
-		index = gen_code_info->tempval_count++;
-	}
-	if (gen_code_info->result.regval.type->variableType() == ASTNodeType::BOOLEAN) {
-		result << "  %" << gen_code_info->tempval_count << " = zext i8 %"
-			<< index << " to i32" << endl;
-		index = gen_code_info->tempval_count++;
-	}
-	result << "  %" << gen_code_info->tempval_count++
-		<< " = call i32 (i8*, ...)* @printf(i8* getelementptr inbounds (["
-		<< 3 <<" x i8]* @.str" << str_table["%d"] <<", i32 0, i32 0), i32 %"
-		<< index << ")" << endl;
+		result << gen_load(gen_code_info, gen_code_info->result);
+		index = gen_code_info->result.regval.index;
+	}
+	if (gen_code_info->result.regval.type->variableType() == ASTNodeType::BOOLEAN)
+		result << "  call void @dragon_print_bool(i1 %" << index << ")" << endl;
+	else
+		result << "  call void @dragon_print_i32(i32 %" << index << ")" << endl;
+	return result.str();
+}
+
+string ASTNodePrintStmt::gen_text(const string &text) {
+	stringstream result;
+	if (text.empty())
+		return "";
+	result << "  call void @dragon_print_str(i8* getelementptr inbounds (["
+		<< text.size() + 1 <<" x i8]* @.str" << str_table[text] <<", i32 0, i32 0), i32 "
+		<< text.size() << ")" << endl;
 	return result.str();
 }
 
@@ -2003,19 +4738,13 @@ string ASTNodePrintStmt::gen_code(GenCodeInfo* gen_code_info, ASTNodeExpression*
 	}
 	else if (gen_code_info->result_type == GenCodeInfo::POINTER ||
 			gen_code_info->result_type == GenCodeInfo::VALUE) {
-		ASTNodeType* type = gen_code_info->result.regval.type;
+		Type* type = gen_code_info->result.regval.type;
 		if (type->variableType() == ASTNodeType::INTEGER ||
-				type->variableType() == ASTNodeType::BOOLEAN) {
+				type->variableType() == ASTNodeType::BOOLEAN ||
+				type->variableType() == ASTNodeType::ARRAY ||
+				type->variableType() == ASTNodeType::CLASS) {
 			return ret + gen_composed(gen_code_info);
 		}
-		else if (class_table.find(type->getValue()) != class_table.end()) {
-			ss << gen_code_info->loc << " error[TODO]: we don't support printing class" << endl;
-			throw runtime_error(ss.str());
-		}
-		else if (array_table.find(type->getValue()) != array_table.end()) {
-			ss << gen_code_info->loc << " error[TODO]: we don't support printing array" << endl;
-			throw runtime_error(ss.str());
-		}
 		else {
 			ss << gen_code_info->loc << " panic: unexpected code path, BUG in code!" << endl;
 			throw runtime_error(ss.str());
@@ -2025,13 +4754,19 @@ string ASTNodePrintStmt::gen_code(GenCodeInfo* gen_code_info, ASTNodeExpression*
 
 string ASTNodePrintStmt::gen_code(GenCodeInfo* gen_code_info) {
 	stringstream ss;
-	vector<ASTNode*> &expr_list = children[0]->getChildren();
+	ChildList expr_list = children[0]->getChildren();
 	if (expr_list.empty()) {
-		ss << loc << " error: print statement may not be empty" << endl;
+		ss << getLoc() << " error: print statement may not be empty" << endl;
 		throw runtime_error(ss.str());
 	}
-	for (int i = 0; i < expr_list.size(); ++i)
-		ss << gen_code(gen_code_info, dynamic_cast<ASTNodeExpression*>(expr_list[i]));
+	// a run of literals is printed as the string collect_info() merged it into
+	int text = 0;
+	for (int i = 0; i < expr_list.size(); ++i) {
+		if (!is_literal(expr_list[i]))
+			ss << gen_code(gen_code_info, dynamic_cast<ASTNodeExpression*>(expr_list[i]));
+		else if (i + 1 == expr_list.size() || !is_literal(expr_list[i + 1]))
+			ss << gen_text(texts[text++]);
+	}
 	return ss.str();
 }
 
@@ -2039,14 +4774,14 @@ string ASTNodeReturnStmt::gen_code(GenCodeInfo* gen_code_info) {
 	stringstream ss, result;
 	string code;
 	GenCodeInfo::Result &ret_result = gen_code_info->result;
-	ASTNodeType *ret_type = gen_code_info->ret_type;
+	Type *ret_type = gen_code_info->ret_type;
 	if (children.empty()) {
 		if (gen_code_info->ret_type->variableType() != ASTNodeType::VOID) {
-			ss << loc << " error: non-void function should return a value" << endl;
+			ss << getLoc() << " error: non-void function should return a value" << endl;
 			throw runtime_error(ss.str());
 		}
 		else
-			code = "  ret void\n";
+			code = gen_arena_release(gen_code_info) + "  ret void\n";
 	}
 	else {
 		code = dynamic_cast<ASTNodeExpression*>(children[0])->gen_code(gen_code_info);
@@ -2061,29 +4796,19 @@ string ASTNodeReturnStmt::gen_code(GenCodeInfo* gen_code_info) {
 		// since we can't return array type, it's safe not to take it into consideration
 		else if (gen_code_info->result_type == GenCodeInfo::POINTER ||
 				gen_code_info->result_type == GenCodeInfo::VALUE) {
-			if (gen_code_info->result_type == GenCodeInfo::POINTER) {
-				result << "  %" << gen_code_info->tempval_count << " = load "
-					<< ret_result.regval.type->getTypeAsm(false) << "* %";
-				if (ret_result.regval.index >= 0)
-					result << ret_result.regval.index;
-				else
-					result << ret_result.regval.id;
-				result << ", align 4" << endl;
-				ret_result.regval.index = gen_code_info->tempval_count++;
-			}
+			if (gen_code_info->result_type == GenCodeInfo::POINTER)
+				result << gen_load(gen_code_info, ret_result);
 ret_variable:
-			if (ret_result.regval.type->getValue() != ret_type->getValue()) {
+			if (ret_result.regval.type != ret_type) {
 				if (ret_result.regval.type->variableType() == ASTNodeType::INTEGER &&
 						ret_type->variableType() == ASTNodeType::BOOLEAN) {
-					result << "  %" << gen_code_info->tempval_count++ << " = icmp ne i32 %"
+					result << "  %" << gen_code_info->tempval_count << " = icmp ne i32 %"
 						<< ret_result.regval.index << ", 0" << endl;
-					result << "  %" << gen_code_info->tempval_count << " = zext i1 %"
-						<< gen_code_info->tempval_count - 1 << " to i8" << endl;
 					ret_result.regval.index = gen_code_info->tempval_count++;
 				}
 				else if (ret_result.regval.type->variableType() == ASTNodeType::BOOLEAN &&
 						ret_type->variableType() == ASTNodeType::INTEGER) {
-					result << "  %" << gen_code_info->tempval_count << " = zext i8 %"
+					result << "  %" << gen_code_info->tempval_count << " = zext i1 %"
 						<< ret_result.regval.index << " to i32" << endl;
 					ret_result.regval.index = gen_code_info->tempval_count++;
 				}
@@ -2093,7 +4818,15 @@ ret_variable:
 					throw runtime_error(ss.str());
 				}
 			}
-			result << "  ret " << ret_type->getTypeAsm(false) << " %" << ret_result.regval.index << endl;
+			if (ret_type->variableType() == ASTNodeType::CLASS) {
+				result << "  store " << ret_type->getAsm() << " %" << ret_result.regval.index << ", "
+					<< ret_type->getAsm() << "* %...ret, align " << ret_type->getAlign() << endl;
+				result << gen_arena_release(gen_code_info) << "  ret void" << endl;
+			}
+			else {
+				result << gen_arena_release(gen_code_info);
+				result << "  ret " << ret_type->getRegAsm() << " %" << ret_result.regval.index << endl;
+			}
 			code += result.str();
 		}
 		else {
@@ -2114,12 +4847,13 @@ ret_variable:
 					value = dynamic_cast<ASTNodeInteger*>(expr)->getValue();
 				else
 					value = dynamic_cast<ASTNodeBoolean*>(expr)->getValue();
+				result << gen_arena_release(gen_code_info);
 				if (ret_type->variableType() == ASTNodeType::INTEGER) {
 					result << "  ret i32 " << value << endl;
 					code += result.str();
 				}
 				else if (ret_type->variableType() == ASTNodeType::BOOLEAN) {
-					result << "  ret i8 " << value << endl;
+					result << "  ret i1 " << (value ? "true" : "false") << endl;
 					code += result.str();
 				}
 				else {
@@ -2156,6 +4890,7 @@ string ASTNodeBlock::gen_code(GenCodeInfo* gen_code_info) {
 		vector<int> continue_point = gen_code_info->continue_point;
 		int tempval_count = gen_code_info->tempval_count;
 		int current_block = gen_code_info->current_block;
+		GenCodeInfo::Available available = gen_code_info->available;
 		for (; i < children.size(); ++i)
 			dynamic_cast<ASTNodeStatement*>(children[i])->gen_code(gen_code_info);
 		gen_code_info->block_isover = true;
@@ -2164,6 +4899,7 @@ string ASTNodeBlock::gen_code(GenCodeInfo* gen_code_info) {
 		gen_code_info->continue_point = continue_point;
 		gen_code_info->tempval_count = tempval_count;
 		gen_code_info->current_block = current_block;
+		gen_code_info->available = available;
 	}
 	return ss.str();
 }
@@ -2178,7 +4914,7 @@ string ASTNodeBreakStmt::gen_code(GenCodeInfo* gen_code_info) {
 		return ss.str();
 	}
 	else {
-		ss << loc << " error: 'break' statement not in loop statement" << endl;
+		ss << getLoc() << " error: 'break' statement not in loop statement" << endl;
 		throw runtime_error(ss.str());
 	}
 }
@@ -2193,7 +4929,7 @@ string ASTNodeContinueStmt::gen_code(GenCodeInfo* gen_code_info) {
 		return ss.str();
 	}
 	else {
-		ss << loc << " error: 'continue' statement not in loop statement" << endl;
+		ss << getLoc() << " error: 'continue' statement not in loop statement" << endl;
 		throw runtime_error(ss.str());
 	}
 }
@@ -2214,28 +4950,15 @@ static string load_bool(GenCodeInfo* gen_code_info, ASTNodeExpression* expr,
 	}
 	else if (gen_code_info->result_type == GenCodeInfo::POINTER ||
 			gen_code_info->result_type == GenCodeInfo::VALUE) {
-		if (gen_code_info->result_type == GenCodeInfo::POINTER) {
-			result << "  %" << gen_code_info->tempval_count << " = load "
-				<< expr_result.regval.type->getAsm() << "* %";
-			if (expr_result.regval.index >= 0)
-				result << expr_result.regval.index;
-			else
-				result << expr_result.regval.id;
-			result << ", align 4" << endl;
-			expr_result.regval.index = gen_code_info->tempval_count++;
-		}
+		if (gen_code_info->result_type == GenCodeInfo::POINTER)
+			result << gen_load(gen_code_info, expr_result);
 load_variable:
 		if (expr_result.regval.type->variableType() == ASTNodeType::INTEGER) {
 			result << "  %" << gen_code_info->tempval_count << " = icmp ne i32 %"
 				<< expr_result.regval.index << ", 0" << endl;
 			expr_result.regval.index = gen_code_info->tempval_count++;
 		}
-		else if (expr_result.regval.type->variableType() == ASTNodeType::BOOLEAN) {
-			result << "  %" << gen_code_info->tempval_count << " = trunc i8 %"
-				<< expr_result.regval.index << " to i1" << endl;
-			expr_result.regval.index = gen_code_info->tempval_count++;
-		}
-		else {
+		else if (expr_result.regval.type->variableType() != ASTNodeType::BOOLEAN) {
 			ss << gen_code_info->loc << " error: expected boolean type, but get type '"
 				<< expr_result.regval.type->getValue() << "'" << endl;
 			throw runtime_error(ss.str());
@@ -2271,6 +4994,90 @@ load_variable:
 	return code;
 }
 
+static string new_label_hole() {
+	stringstream ss;
+	ss << LABEL_FLAG << label_hole_count++ << LABEL_FLAG;
+	return ss.str();
+}
+
+static void fill_label(string &code, const string &hole, int label) {
+	stringstream ss;
+	ss << label;
+	for (size_t i = code.find(hole); i != string::npos; i = code.find(hole, i))
+		code.replace(i, hole.size(), ss.str());
+}
+
+static string pred_list(const vector<int> &preds) {
+	stringstream ss;
+	for (int i = preds.size() - 1; i >= 0; --i) {
+		ss << "%" << preds[i];
+		if (i != 0)
+			ss << ", ";
+	}
+	return ss.str();
+}
+
+// generates expr as the condition of a branch to true_label or false_label,
+// recording the blocks that jump to each. 'and'/'or' jump straight to the
+// targets instead of computing their value, a constant condition generates
+// no branch and is left to the caller.
+static string gen_cond(GenCodeInfo* gen_code_info, ASTNodeExpression* expr,
+		const string &true_label, const string &false_label,
+		vector<int> &true_preds, vector<int> &false_preds, bool &isconstant, bool &value) {
+	stringstream result;
+	ASTNodeBinaryExpr *binary = dynamic_cast<ASTNodeBinaryExpr*>(expr);
+	if (binary == NULL || (binary->getOp() != "and" && binary->getOp() != "or") ||
+			dynamic_cast<ASTNodeExpression*>(binary->getChildren()[0])->eval().first ||
+			dynamic_cast<ASTNodeExpression*>(binary->getChildren()[1])->eval().first) {
+		int index;
+		result << load_bool(gen_code_info, expr, index, isconstant, value);
+		if (!isconstant) {
+			result << "  br i1 %" << index << ", label %" << true_label
+				<< ", label %" << false_label << endl;
+			true_preds.push_back(gen_code_info->current_block);
+			false_preds.push_back(gen_code_info->current_block);
+		}
+		return result.str();
+	}
+
+	// the right operand starts a block of its own, reached from the left one
+	bool isand = binary->getOp() == "and";
+	string next_label = new_label_hole();
+	vector<int> next_preds;
+	string code = gen_cond(gen_code_info, dynamic_cast<ASTNodeExpression*>(binary->getChildren()[0]),
+			isand ? next_label : true_label, isand ? false_label : next_label,
+			isand ? next_preds : true_preds, isand ? false_preds : next_preds, isconstant, value);
+	if (isconstant) {
+		if (value == isand) {
+			result << "  br label %" << next_label << endl;
+			next_preds.push_back(gen_code_info->current_block);
+		}
+		else {
+			result << "  br label %" << (isand ? false_label : true_label) << endl;
+			(isand ? false_preds : true_preds).push_back(gen_code_info->current_block);
+		}
+	}
+	int next_block = gen_code_info->tempval_count++;
+	result << endl;
+	result << "; <label>:";
+	result.setf(ios::left, ios::adjustfield);
+	result.width(40);
+	result << next_block << "; preds = " << pred_list(next_preds) << endl;
+	result.unsetf(ios::adjustfield);
+	gen_code_info->current_block = next_block;
+	code += result.str();
+	fill_label(code, next_label, next_block);
+
+	code += gen_cond(gen_code_info, dynamic_cast<ASTNodeExpression*>(binary->getChildren()[1]),
+			true_label, false_label, true_preds, false_preds, isconstant, value);
+	if (isconstant) {
+		code += "  br label %" + (value ? true_label : false_label) + "\n";
+		(value ? true_preds : false_preds).push_back(gen_code_info->current_block);
+	}
+	isconstant = false;
+	return code;
+}
+
 static void replace_label(string &block, string break_label, string continue_label) {
 	for (int i = 0; i < block.size(); ++i) {
 		if (block[i] == BREAK_FLAG) {
@@ -2303,17 +5110,121 @@ static void replace_label(string &block, string break_label, string continue_lab
 	}
 }
 
+// the integer variable compared with a constant in expr, NULL if expr isn't such a test
+static ASTNodeID* get_case(ASTNodeExpression *expr, int &value) {
+	ASTNodeBinaryExpr *binary = dynamic_cast<ASTNodeBinaryExpr*>(expr);
+	if (binary == NULL || binary->getOp() != "==")
+		return NULL;
+	ASTNodeID *id = dynamic_cast<ASTNodeID*>(binary->getChildren()[0]);
+	ASTNodeExpression *constant = dynamic_cast<ASTNodeExpression*>(binary->getChildren()[1]);
+	if (id == NULL) {
+		id = dynamic_cast<ASTNodeID*>(binary->getChildren()[1]);
+		constant = dynamic_cast<ASTNodeExpression*>(binary->getChildren()[0]);
+	}
+	if (id == NULL)
+		return NULL;
+	const Binding &binding = id->getBinding();
+	if (binding.kind != Binding::LOCAL && binding.kind != Binding::PARAM && binding.kind != Binding::FIELD)
+		return NULL;
+	if (binding.type->variableType() != ASTNodeType::INTEGER)
+		return NULL;
+	pair<bool, int> result = constant->eval();
+	if (!result.first)
+		return NULL;
+	value = result.second;
+	return id;
+}
+
+string ASTNodeIfThenElseStmt::gen_switch(GenCodeInfo* gen_code_info, ASTNodeID *id,
+		const vector<int> &cases) {
+	stringstream result, arms;
+	int index;
+	Type *type;
+	result << load_id(gen_code_info, id, index, NULL, &type);
+	int switch_block = gen_code_info->current_block;
+	string end_label = new_label_hole();
+	vector<int> blocks, end_preds;
+	bool block_isover = true;
+	bool terminated_bybr;
+	// the arms in order, the else block last as the default
+	vector<ASTNodeBlock*> bodies;
+	for (int i = 1; i < children.size(); i += 2)
+		bodies.push_back(dynamic_cast<ASTNodeBlock*>(children[i]));
+	bodies.push_back(dynamic_cast<ASTNodeBlock*>(children.back()));
+	for (auto body : bodies) {
+		int block = gen_code_info->tempval_count++;
+		blocks.push_back(block);
+		arms << endl;
+		arms << "; <label>:";
+		arms.setf(ios::left, ios::adjustfield);
+		arms.width(40);
+		arms << block << "; preds = %" << switch_block << endl;
+		arms.unsetf(ios::adjustfield);
+		gen_code_info->current_block = block;
+		arms << body->gen_code(gen_code_info);
+		if (!gen_code_info->block_isover) {
+			arms << "  br label %" << end_label << endl;
+			end_preds.push_back(gen_code_info->current_block);
+			block_isover = false;
+		}
+		else
+			terminated_bybr = gen_code_info->terminated_bybr;
+	}
+
+	result << "  switch i32 %" << index << ", label %" << blocks.back() << " [" << endl;
+	for (int i = 0; i < cases.size(); ++i)
+		result << "    i32 " << cases[i] << ", label %" << blocks[i] << endl;
+	result << "  ]" << endl;
+
+	string code = result.str() + arms.str();
+	if (block_isover) {
+		gen_code_info->block_isover = true;
+		gen_code_info->terminated_bybr = terminated_bybr;
+		return code;
+	}
+	int end_block = gen_code_info->tempval_count++;
+	fill_label(code, end_label, end_block);
+	result.str("");
+	result << endl;
+	result << "; <label>:";
+	result.setf(ios::left, ios::adjustfield);
+	result.width(40);
+	result << end_block << "; preds = " << pred_list(end_preds) << endl;
+	result.unsetf(ios::adjustfield);
+	gen_code_info->current_block = end_block;
+	gen_code_info->block_isover = false;
+	return code + result.str();
+}
+
 string ASTNodeIfThenElseStmt::gen_code(GenCodeInfo* gen_code_info) {
+	// an elif chain testing one integer against distinct constants becomes a switch
+	if (children.size() % 2 == 1 && children.size() / 2 >= SWITCH_MIN_CASES) {
+		vector<int> cases;
+		ASTNodeID *id = NULL;
+		int i;
+		for (i = 0; i < children.size() - 1; i += 2) {
+			int value;
+			ASTNodeID *case_id = get_case(dynamic_cast<ASTNodeExpression*>(children[i]), value);
+			if (case_id == NULL || (id && case_id->getNameId() != id->getNameId()) ||
+					find(cases.begin(), cases.end(), value) != cases.end())
+				break;
+			id = case_id;
+			cases.push_back(value);
+		}
+		if (i == children.size() - 1)
+			return gen_switch(gen_code_info, id, cases);
+	}
+
 	bool block_isover = true;
 	bool terminated_bybr;
 
 	stringstream prologue;
-	int prev_block, expr_block_begin, expr_block_end;
+	int prev_block, expr_block_begin;
 	int condition_block_begin, condition_block_end, next_block;
 	prev_block = gen_code_info->current_block;
 	prologue << "  br label %" << gen_code_info->tempval_count << endl;
 	expr_block_begin = gen_code_info->tempval_count++;
-	gen_code_info->current_block = expr_block_begin;
+	enter_successor(gen_code_info, expr_block_begin);
 	prologue << endl;
 	prologue << "; <label>:";
 	prologue.setf(ios::left, ios::adjustfield);
@@ -2322,35 +5233,52 @@ string ASTNodeIfThenElseStmt::gen_code(GenCodeInfo* gen_code_info) {
 	prologue.unsetf(ios::adjustfield);
 
 	vector<pair<string, bool>> body;
-	vector<int> expr_block_end_list, next_block_list;
+	vector<int> next_block_list;
+	// the blocks jumping to the next condition, when one is false
+	vector<string> false_preds_list;
+	string false_preds;
 	vector<pair<int, bool>> condition_block_end_list;
 	bool break_out = false;
 	int tempval_count, current_block;
+	GenCodeInfo::Available available, test;
 	vector<int> break_point, continue_point;
 	stringstream expr, condition;
 	for (int i = 0; i < children.size() - 1; i += 2) {
-		int index;
 		bool isconstant;
 		bool value;
-		expr << load_bool(gen_code_info, dynamic_cast<ASTNodeExpression*>(children[i]),
-				index, isconstant, value);
-		expr_block_end = gen_code_info->current_block;
+		bool from_test = false;
+		string true_label = new_label_hole(), false_label = new_label_hole();
+		vector<int> true_preds, false_preds_vec;
+		string cond = gen_cond(gen_code_info, dynamic_cast<ASTNodeExpression*>(children[i]),
+				true_label, false_label, true_preds, false_preds_vec, isconstant, value);
 		if (isconstant) {
 			if (value) {
 				condition_block_begin = expr_block_begin;
 			}
-			else {
+			else if (!break_out) {
+				// an arm after the taken one must not overwrite its state
 				tempval_count = gen_code_info->tempval_count;
 				current_block = gen_code_info->current_block;
+				available = gen_code_info->available;
 				break_point = gen_code_info->break_point;
 				continue_point = gen_code_info->continue_point;
 			}
 		}
 		else {
-			expr << "  br i1 %" << index;
-			expr << ", label %" << gen_code_info->tempval_count;
 			condition_block_begin = gen_code_info->tempval_count++;
-			gen_code_info->current_block = condition_block_begin;
+			fill_label(cond, true_label, condition_block_begin);
+			// the next condition, or the else arm, can use the values of the
+			// test too when it alone jumps there
+			if (false_preds_vec.size() == 1 && false_preds_vec[0] == gen_code_info->current_block &&
+					gen_code_info->available.block == gen_code_info->current_block &&
+					i + 2 < children.size()) {
+				from_test = true;
+				test = gen_code_info->available;
+			}
+			if (true_preds.size() == 1 && true_preds[0] == gen_code_info->current_block)
+				enter_successor(gen_code_info, condition_block_begin);
+			else
+				gen_code_info->current_block = condition_block_begin;
 		}
 
 		condition << dynamic_cast<ASTNodeBlock*>(children[i + 1])->gen_code(gen_code_info);
@@ -2359,13 +5287,19 @@ string ASTNodeIfThenElseStmt::gen_code(GenCodeInfo* gen_code_info) {
 		condition_block_end = gen_code_info->current_block;
 		next_block = gen_code_info->tempval_count++;
 		gen_code_info->current_block = next_block;
+		if (from_test) {
+			gen_code_info->available = test;
+			gen_code_info->available.block = next_block;
+		}
 
-		expr << ", label %" << next_block << endl;
+		fill_label(cond, false_label, next_block);
+		false_preds = pred_list(false_preds_vec);
+		expr << cond;
 		expr << endl;
 		expr << "; <label>:";
 		expr.setf(ios::left, ios::adjustfield);
 		expr.width(40);
-		expr << condition_block_begin << "; preds = %" << expr_block_end << endl;
+		expr << condition_block_begin << "; preds = " << pred_list(true_preds) << endl;
 		expr.unsetf(ios::adjustfield);
 
 		if (break_out)
@@ -2382,12 +5316,14 @@ string ASTNodeIfThenElseStmt::gen_code(GenCodeInfo* gen_code_info) {
 				break_out = true;
 				tempval_count = gen_code_info->tempval_count;
 				current_block = gen_code_info->current_block;
+				available = gen_code_info->available;
 				break_point = gen_code_info->break_point;
 				continue_point = gen_code_info->continue_point;
 			}
 			else {
 				gen_code_info->tempval_count = tempval_count;
 				gen_code_info->current_block = current_block;
+				gen_code_info->available = available;
 				gen_code_info->break_point = break_point;
 				gen_code_info->continue_point = continue_point;
 			}
@@ -2395,7 +5331,7 @@ string ASTNodeIfThenElseStmt::gen_code(GenCodeInfo* gen_code_info) {
 		else {
 			body.push_back(make_pair(expr.str(), false));
 			body.push_back(make_pair(condition.str(), gen_code_info->block_isover));
-			expr_block_end_list.push_back(expr_block_end);
+			false_preds_list.push_back(false_preds);
 			condition_block_end_list.push_back(
 					make_pair(condition_block_end, gen_code_info->block_isover));
 			next_block_list.push_back(next_block);
@@ -2414,6 +5350,8 @@ string ASTNodeIfThenElseStmt::gen_code(GenCodeInfo* gen_code_info) {
 		// if (expr) {}
 		if (body.empty()) {
 			gen_code_info->tempval_count--;
+			if (gen_code_info->available.block == expr_block_begin)
+				gen_code_info->available.block = prev_block;
 			gen_code_info->current_block = prev_block;
 			gen_code_info->block_isover = false;
 			return "";
@@ -2429,7 +5367,7 @@ string ASTNodeIfThenElseStmt::gen_code(GenCodeInfo* gen_code_info) {
 				tmp << next_block << "; preds = %" << condition_block_end;
 				tmp.unsetf(ios::adjustfield);
 				if (body.size() != 1)
-					tmp << ", %" << expr_block_end;
+					tmp << ", " << false_preds;
 				tmp << endl;
 			}
 			if (body.size() == 1) {
@@ -2465,6 +5403,7 @@ string ASTNodeIfThenElseStmt::gen_code(GenCodeInfo* gen_code_info) {
 				gen_code_info->current_block = current_block;
 				gen_code_info->tempval_count = tempval_count;
 			}
+			gen_code_info->available = available;
 			gen_code_info->break_point = break_point;
 			gen_code_info->continue_point = continue_point;
 		}
@@ -2519,8 +5458,8 @@ string ASTNodeIfThenElseStmt::gen_code(GenCodeInfo* gen_code_info) {
 			tmp << "; <label>:";
 			tmp.setf(ios::left, ios::adjustfield);
 			tmp.width(40);
-			tmp << next_block_list[i >> 1] << "; preds = %"
-				<< expr_block_end_list[i >> 1] << endl;
+			tmp << next_block_list[i >> 1] << "; preds = "
+				<< false_preds_list[i >> 1] << endl;
 			tmp.unsetf(ios::adjustfield);
 			result += body[i].first + body[i + 1].first + tmp.str();
 			tmp.str("");
@@ -2529,32 +5468,281 @@ string ASTNodeIfThenElseStmt::gen_code(GenCodeInfo* gen_code_info) {
 	}
 }
 
+// Loop-invariant code motion. Before a loop is generated, what can't change
+// while it runs is computed once in the block entering it: loads of variables
+// the loop never assigns, addresses of fields and of elements at invariant
+// subscripts, and arithmetic on those. The uses in the loop then get the
+// hoisted registers from gen_pure().
+
+// the integer and boolean variables assigned in node, by name id
+static void collect_assigned(ASTNode *node, set<uint32_t> &assigned) {
+	ChildList children = node->getChildren();
+	ASTNodeID *id = NULL;
+	if (node->type() == ASTNode::BINARY_EXPR &&
+			dynamic_cast<ASTNodeBinaryExpr*>(node)->getOp() == ":=")
+		id = tracked_id(children[0]);
+	else if (node->type() == ASTNode::FOREACH_STMT)
+		id = tracked_id(children[0]);
+	if (id)
+		assigned.insert(id->getNameId());
+	for (int i = 0; i < children.size(); ++i)
+		collect_assigned(children[i], assigned);
+}
+
+static bool is_invariant(ASTNode *node, const set<uint32_t> &assigned) {
+	if (node->type() == ASTNode::INTEGER || node->type() == ASTNode::BOOLEAN)
+		return true;
+	else if (node->type() == ASTNode::IDENTIFIER) {
+		ASTNodeID *id = tracked_id(node);
+		return id && assigned.find(id->getNameId()) == assigned.end();
+	}
+	else if (node->type() != ASTNode::BINARY_EXPR)
+		return false;
+	const string &op = dynamic_cast<ASTNodeBinaryExpr*>(node)->getOp();
+	ChildList children = node->getChildren();
+	if (op == ":=" || is_logical(op))
+		return false;
+	// a division is only moved when it can't trap
+	if ((op == "/" || op == "%") && (children[1]->type() != ASTNode::INTEGER ||
+			dynamic_cast<ASTNodeInteger*>(children[1])->getValue() == 0))
+		return false;
+	return is_invariant(children[0], assigned) && is_invariant(children[1], assigned);
+}
+
+// whether node, an access path, always has the same address in the loop
+static bool is_invariant_address(ASTNode *node, const set<uint32_t> &assigned) {
+	ChildList children = node->getChildren();
+	if (node->type() == ASTNode::IDENTIFIER) {
+		Binding::Kind kind = dynamic_cast<ASTNodeID*>(node)->getBinding().kind;
+		return kind == Binding::LOCAL || kind == Binding::PARAM || kind == Binding::FIELD;
+	}
+	else if (node->type() == ASTNode::THIS)
+		return true;
+	else if (node->type() == ASTNode::FIELD_ACCESS)
+		return is_invariant_address(children[0], assigned);
+	else if (node->type() == ASTNode::ARRAY_ACCESS)
+		return is_invariant_address(children[0], assigned) && is_invariant(children[1], assigned);
+	return false;
+}
+
+// generates node into code, its value or else its address, so that the loop
+// finds the registers; what fails is left to be reported in the loop
+static void hoist(GenCodeInfo* gen_code_info, ASTNode *node, stringstream &code) {
+	int tempval_count = gen_code_info->tempval_count;
+	GenCodeInfo::Available available = gen_code_info->available;
+	map<string, int> invariant = gen_code_info->invariant;
+	ASTNode *packed_lvalue = gen_code_info->packed_lvalue;
+	try {
+		string hoisted;
+		ASTNodeID *id = dynamic_cast<ASTNodeID*>(node);
+		int index;
+		string index_id;
+		Type *type;
+		// an element of a packed array is hoisted as the address of its word
+		gen_code_info->packed_lvalue = node;
+		if (id && id->getBinding().kind == Binding::FIELD)
+			hoisted = find_id(gen_code_info, id, index, index_id, &type);
+		else if (id)
+			hoisted = load_id(gen_code_info, id, index, NULL, &type);
+		else
+			hoisted = dynamic_cast<ASTNodeExpression*>(node)->gen_code(gen_code_info);
+		code << hoisted;
+	}
+	catch (runtime_error &e) {
+		gen_code_info->tempval_count = tempval_count;
+		gen_code_info->available = available;
+		gen_code_info->invariant = invariant;
+	}
+	gen_code_info->packed_lvalue = packed_lvalue;
+}
+
+static void hoist_node(GenCodeInfo* gen_code_info, ASTNode *node,
+		const set<uint32_t> &assigned, stringstream &code) {
+	ChildList children = node->getChildren();
+	if (node->type() == ASTNode::INTEGER || node->type() == ASTNode::BOOLEAN)
+		return;
+	else if (is_invariant(node, assigned))
+		hoist(gen_code_info, node, code);
+	else if ((node->type() == ASTNode::FIELD_ACCESS || node->type() == ASTNode::ARRAY_ACCESS ||
+				(node->type() == ASTNode::IDENTIFIER &&
+				 dynamic_cast<ASTNodeID*>(node)->getBinding().kind == Binding::FIELD)) &&
+			is_invariant_address(node, assigned))
+		hoist(gen_code_info, node, code);
+	else if (node->type() == ASTNode::FIELD_ACCESS)
+		hoist_node(gen_code_info, children[0], assigned, code);
+	else {
+		for (int i = 0; i < children.size(); ++i)
+			hoist_node(gen_code_info, children[i], assigned, code);
+	}
+}
+
+// the code computing the invariants of loop, to run before entering it
+static string hoist_invariants(GenCodeInfo* gen_code_info, ASTNode *loop) {
+	set<uint32_t> assigned;
+	collect_assigned(loop, assigned);
+	stringstream code;
+	gen_code_info->hoisting = true;
+	ChildList children = loop->getChildren();
+	for (int i = 0; i < children.size(); ++i)
+		hoist_node(gen_code_info, children[i], assigned, code);
+	gen_code_info->hoisting = false;
+	return code.str();
+}
+
+// Scalar promotion. The integer and boolean fields of 'this' used in a loop
+// are copied into slots of their own before it, as long as nothing else in
+// the loop can reach them: no call, no return, no 'this' but to access its
+// fields, and no class parameter, which may be 'this' itself. The loop then
+// uses them like locals, and those it writes are copied back where it exits.
+
+struct PromotedField {
+	PromotedField() : type(NULL), written(false) {}
+	Type *type;
+	bool written;
+};
+
+static bool can_promote(ASTNode *node) {
+	ChildList children = node->getChildren();
+	if (node->type() == ASTNode::METHOD_INVOCATION || node->type() == ASTNode::RETURN_STMT ||
+			node->type() == ASTNode::THIS)
+		return false;
+	else if (node->type() == ASTNode::IDENTIFIER) {
+		const Binding &binding = dynamic_cast<ASTNodeID*>(node)->getBinding();
+		return binding.kind != Binding::PARAM || binding.type->variableType() != ASTNodeType::CLASS;
+	}
+	else if (node->type() == ASTNode::FIELD_ACCESS)
+		return children[0]->type() == ASTNode::THIS || can_promote(children[0]);
+	for (int i = 0; i < children.size(); ++i)
+		if (!can_promote(children[i]))
+			return false;
+	return true;
+}
+
+static void collect_fields(GenCodeInfo* gen_code_info, ASTNode *node, bool written,
+		map<vector<int>, PromotedField> &fields) {
+	ChildList children = node->getChildren();
+	const vector<int> *path = NULL;
+	Type *type;
+	if (node->type() == ASTNode::IDENTIFIER) {
+		const Binding &binding = dynamic_cast<ASTNodeID*>(node)->getBinding();
+		if (binding.kind != Binding::FIELD)
+			return;
+		path = binding.path;
+		type = binding.type;
+	}
+	else if (node->type() == ASTNode::FIELD_ACCESS) {
+		if (children[0]->type() != ASTNode::THIS) {
+			collect_fields(gen_code_info, children[0], false, fields);
+			return;
+		}
+		const ClassLayout &layout = gen_code_info->this_type->getLayout();
+		uint32_t name = dynamic_cast<ASTNodeID*>(children[1])->getNameId();
+		auto field = layout.fields.find(name);
+		auto method = layout.methods.find(name);
+		if (field == layout.fields.end() ||
+				(method != layout.methods.end() && method->second.depth <= field->second.depth))
+			return;
+		path = &field->second.path;
+		type = field->second.type;
+	}
+	if (path) {
+		if ((type->variableType() == ASTNodeType::INTEGER ||
+					type->variableType() == ASTNodeType::BOOLEAN) &&
+				gen_code_info->promoted.find(*path) == gen_code_info->promoted.end()) {
+			fields[*path].type = type;
+			fields[*path].written |= written;
+		}
+		return;
+	}
+	bool assign = node->type() == ASTNode::BINARY_EXPR &&
+		dynamic_cast<ASTNodeBinaryExpr*>(node)->getOp() == ":=";
+	for (int i = 0; i < children.size(); ++i)
+		collect_fields(gen_code_info, children[i], assign && i == 0, fields);
+}
+
+// copies the fields loop can keep to itself into their slots, where a field
+// it only reads stays in a register
+static string promote_fields(GenCodeInfo* gen_code_info, ASTNode *loop,
+		map<vector<int>, PromotedField> &fields) {
+	if (gen_code_info->this_type == NULL || !can_promote(loop))
+		return "";
+	collect_fields(gen_code_info, loop, false, fields);
+	stringstream result;
+	for (auto &i : fields) {
+		Binding binding;
+		binding.kind = Binding::FIELD;
+		binding.path = &i.first;
+		binding.type = i.second.type;
+		Type *type = i.second.type;
+		string slot = gen_entry_alloca(gen_code_info, type);
+		int ptr, value;
+		result << find_id_byvar(gen_code_info, binding, ptr, &type);
+		value = gen_inst(gen_code_info, result, load_inst(type, reg(ptr)));
+		result << "  store " << type->getTypeAsm(true) << " %" << value << ", "
+			<< type->getTypeAsm(true) << "* %" << slot << ", align " << type->getAlign(true) << endl;
+		if (!i.second.written) {
+			gen_code_info->available.values[load_inst(type, "%" + slot)] = value;
+			gen_code_info->hoisting = true;
+			result << gen_load_var(gen_code_info, type, "%" + slot, value);
+			gen_code_info->hoisting = false;
+		}
+		gen_code_info->promoted[i.first] = slot;
+	}
+	return result.str();
+}
+
+// copies the promoted fields the loop writes back, where it exits
+static string store_fields(GenCodeInfo* gen_code_info, const map<vector<int>, PromotedField> &fields) {
+	stringstream result;
+	for (auto &i : fields) {
+		if (!i.second.written)
+			continue;
+		Binding binding;
+		binding.kind = Binding::FIELD;
+		binding.path = &i.first;
+		binding.type = i.second.type;
+		Type *type = i.second.type;
+		int ptr, value;
+		value = gen_inst(gen_code_info, result, load_inst(type, "%" + gen_code_info->promoted[i.first]));
+		result << find_id_byvar(gen_code_info, binding, ptr, &type);
+		result << "  store " << type->getTypeAsm(true) << " %" << value << ", "
+			<< type->getTypeAsm(true) << "* %" << ptr << ", align " << type->getAlign(true) << endl;
+	}
+	forget_memory(gen_code_info);
+	return result.str();
+}
+
 string ASTNodeWhileStmt::gen_code(GenCodeInfo* gen_code_info) {
 	stringstream prologue;
 	int prev_block, expr_block_begin, expr_block_end;
 	int loop_block_begin, loop_block_end, end_block;
 	prev_block = gen_code_info->current_block;
+	map<string, int> invariant = gen_code_info->invariant;
+	map<vector<int>, string> promoted = gen_code_info->promoted;
+	map<vector<int>, PromotedField> fields;
+	prologue << promote_fields(gen_code_info, this, fields);
+	prologue << hoist_invariants(gen_code_info, this);
 	prologue << "  br label %" << gen_code_info->tempval_count << endl;
 	expr_block_begin = gen_code_info->tempval_count++;
 	gen_code_info->current_block = expr_block_begin;
 
-	int index;
 	bool isconstant;
 	bool value;
-	stringstream expr;
-	expr << load_bool(gen_code_info, dynamic_cast<ASTNodeExpression*>(children[0]),
-			index, isconstant, value);
+	string true_label = new_label_hole(), false_label = new_label_hole();
+	vector<int> true_preds, false_preds;
+	string cond = gen_cond(gen_code_info, dynamic_cast<ASTNodeExpression*>(children[0]),
+			true_label, false_label, true_preds, false_preds, isconstant, value);
 	expr_block_end = gen_code_info->current_block;
 	if (isconstant) {
-		if (value)
-			expr << "  br i1 true";
-		else
-			expr << "  br i1 false";
+		stringstream br;
+		br << "  br i1 " << (value ? "true" : "false") << ", label %" << true_label
+			<< ", label %" << false_label << endl;
+		cond += br.str();
+		true_preds.push_back(expr_block_end);
+		false_preds.push_back(expr_block_end);
 	}
-	else
-		expr << "  br i1 %" << index;
-	expr << ", label %" << gen_code_info->tempval_count;
 	loop_block_begin = gen_code_info->tempval_count++;
+	fill_label(cond, true_label, loop_block_begin);
 	gen_code_info->current_block = loop_block_begin;
 
 	stringstream loop;
@@ -2588,15 +5776,14 @@ string ASTNodeWhileStmt::gen_code(GenCodeInfo* gen_code_info) {
 		prologue << "%" << gen_code_info->continue_point[i] << ", ";
 	prologue << "%" << prev_block << endl;
 
-	if (isconstant && value)
-		expr << ", label %" << loop_block_begin << endl;
-	else
-		expr << ", label %" << end_block << endl;
+	stringstream expr;
+	fill_label(cond, false_label, isconstant && value ? loop_block_begin : end_block);
+	expr << cond;
 	expr << endl;
 	expr << "; <label>:";
 	expr.setf(ios::left, ios::adjustfield);
 	expr.width(40);
-	expr << loop_block_begin << "; preds = %" << expr_block_end << endl;
+	expr << loop_block_begin << "; preds = " << pred_list(true_preds) << endl;
 	expr.unsetf(ios::adjustfield);
 
 	if (isconstant && value && gen_code_info->break_point.empty()) {
@@ -2619,12 +5806,15 @@ end:
 	loop.unsetf(ios::adjustfield);
 	for (int i = gen_code_info->break_point.size() - 1; i >= 0; --i)
 		loop << "%" << gen_code_info->break_point[i] << ", ";
-	loop << "%" << expr_block_end << endl;
+	loop << pred_list(false_preds) << endl;
+	loop << store_fields(gen_code_info, fields);
 
 ret:
 	gen_code_info->in_loop = in_loop;
 	gen_code_info->break_point = outer_break_point;
 	gen_code_info->continue_point = outer_continue_point;
+	gen_code_info->invariant = invariant;
+	gen_code_info->promoted = promoted;
 	return prologue.str() + expr.str() + block + loop.str();
 }
 
@@ -2633,6 +5823,11 @@ string ASTNodeRepeatStmt::gen_code(GenCodeInfo* gen_code_info) {
 	int prev_block, expr_block_begin, expr_block_end;
 	int loop_block_begin, loop_block_end, end_block;
 	prev_block = gen_code_info->current_block;
+	map<string, int> invariant = gen_code_info->invariant;
+	map<vector<int>, string> promoted = gen_code_info->promoted;
+	map<vector<int>, PromotedField> fields;
+	prologue << promote_fields(gen_code_info, this, fields);
+	prologue << hoist_invariants(gen_code_info, this);
 	prologue << "  br label %" << gen_code_info->tempval_count << endl;
 	loop_block_begin = gen_code_info->tempval_count++;
 	gen_code_info->current_block = loop_block_begin;
@@ -2652,23 +5847,26 @@ string ASTNodeRepeatStmt::gen_code(GenCodeInfo* gen_code_info) {
 	expr_block_begin = gen_code_info->tempval_count++;
 	gen_code_info->current_block = expr_block_begin;
 
-	int index;
 	bool isconstant;
 	bool value;
-	stringstream expr;
-	expr << load_bool(gen_code_info, dynamic_cast<ASTNodeExpression*>(children[1]),
-			index, isconstant, value);
+	string true_label = new_label_hole(), false_label = new_label_hole();
+	vector<int> true_preds, false_preds;
+	string cond = gen_cond(gen_code_info, dynamic_cast<ASTNodeExpression*>(children[1]),
+			true_label, false_label, true_preds, false_preds, isconstant, value);
 	expr_block_end = gen_code_info->current_block;
 	if (isconstant) {
-		if (value)
-			expr << "  br i1 true";
-		else
-			expr << "  br i1 false";
+		stringstream br;
+		br << "  br i1 " << (value ? "true" : "false") << ", label %" << true_label
+			<< ", label %" << false_label << endl;
+		cond += br.str();
+		true_preds.push_back(expr_block_end);
+		false_preds.push_back(expr_block_end);
 	}
-	else
-		expr << "  br i1 %" << index;
-	expr << ", label %" << gen_code_info->tempval_count;
 	end_block = gen_code_info->tempval_count;
+	fill_label(cond, true_label, end_block);
+	fill_label(cond, false_label, loop_block_begin);
+	stringstream expr;
+	expr << cond;
 
 	prologue << endl;
 	prologue << "; <label>:";
@@ -2676,7 +5874,7 @@ string ASTNodeRepeatStmt::gen_code(GenCodeInfo* gen_code_info) {
 	prologue.width(40);
 	prologue << loop_block_begin << "; preds = ";
 	prologue.unsetf(ios::adjustfield);
-	prologue << "%" << expr_block_end << ", %" << prev_block << endl;
+	prologue << pred_list(false_preds) << ", %" << prev_block << endl;
 
 	loop << endl;
 	loop << "; <label>:";
@@ -2695,8 +5893,6 @@ string ASTNodeRepeatStmt::gen_code(GenCodeInfo* gen_code_info) {
 		loop << "%" << gen_code_info->continue_point[0];
 	loop << endl;
 
-	expr << ", label %" << loop_block_begin << endl;
-
 	stringstream ss_break, ss_continue;
 	ss_break << end_block;
 	ss_continue << expr_block_begin;
@@ -2729,20 +5925,23 @@ end:
 	expr.width(40);
 	expr << end_block << "; preds = ";
 	expr.unsetf(ios::adjustfield);
-	expr << "%" << loop_block_end;
+	expr << pred_list(true_preds);
 	for (int i = gen_code_info->break_point.size() - 1; i >= 0; --i)
 		expr << ", %" << gen_code_info->break_point[i];
 	expr << endl;
+	expr << store_fields(gen_code_info, fields);
 
 ret:
 	gen_code_info->in_loop = in_loop;
 	gen_code_info->break_point = outer_break_point;
 	gen_code_info->continue_point = outer_continue_point;
+	gen_code_info->invariant = invariant;
+	gen_code_info->promoted = promoted;
 	return prologue.str() + block + loop.str() + expr.str();
 }
 
 static string get_parray(GenCodeInfo* gen_code_info, ASTNodeExpression* expr,
-		int &index, string &id, ASTNodeType **type) {
+		int &index, string &id, Type **type) {
 	stringstream ss, result;
 	string code;
 	GenCodeInfo::Result &expr_result = gen_code_info->result;
@@ -2770,7 +5969,7 @@ load_variable:
 			<< ", but get a boolean value" << endl;
 		throw runtime_error(ss.str());
 		}
-		else if (array_table.find(expr_result.regval.type->getValue()) == array_table.end()){
+		else if (expr_result.regval.type->variableType() != ASTNodeType::ARRAY) {
 			ss << gen_code_info->loc << " error: expected value of array type, but get class type '"
 				<< expr_result.regval.type->getValue() << "'" << endl;
 			throw runtime_error(ss.str());
@@ -2815,11 +6014,11 @@ load_variable:
 string ASTNodeForEachStmt::gen_code(GenCodeInfo* gen_code_info) {
 	stringstream ss;
 	string iter_id = dynamic_cast<ASTNodeID*>(children[0])->getID();
-	ASTNodeType *iter_type;
+	Type *iter_type;
 	string iter_type_asm;
-	if (gen_code_info->localvar_table &&
-			gen_code_info->localvar_table->find(iter_id) != gen_code_info->localvar_table->end()) {
-		iter_type = (*gen_code_info->localvar_table)[iter_id];
+	const Binding &iter_binding = dynamic_cast<ASTNodeID*>(children[0])->getBinding();
+	if (iter_binding.kind == Binding::LOCAL) {
+		iter_type = iter_binding.type;
 	}
 	else {
 		ss << children[0]->getLoc() << " error: iterator in for-each statement "
@@ -2830,37 +6029,55 @@ string ASTNodeForEachStmt::gen_code(GenCodeInfo* gen_code_info) {
 
 	int expr_index;
 	string expr_id;
-	ASTNodeType *expr_type;
+	Type *expr_type;
 	string expr_type_asm;
 	stringstream prologue;
 	prologue << get_parray(gen_code_info,
 			dynamic_cast<ASTNodeExpression*>(children[1]), expr_index, expr_id, &expr_type);
-	if (iter_type->getValue() != dynamic_cast<ASTNodeType*>
-			(array_table[expr_type->getValue()]->getChildren()[2])->getValue()) {
+	if (iter_type != expr_type->getElement()) {
 		ss << children[1]->getLoc() << " error: type of iterator and container not match"
 			<< " in for-each statement " << endl;
 		throw runtime_error(ss.str());
 	}
-	expr_type_asm = dynamic_cast<ASTNodeType*>
-		(array_table[expr_type->getValue()]->getChildren()[2])->getAsm();
+	expr_type_asm = expr_type->getAsm();
 
 	int count_id;
 	int prev_block, expr_block;
 	prologue << "  %" << gen_code_info->tempval_count << " = alloca i32, align 4" << endl;
 	count_id = gen_code_info->tempval_count++;
 	prologue << "  store i32 0, i32* %" << count_id << ", align 4" << endl;
-	prologue << "  %" << gen_code_info->tempval_count++ << " = getelementptr inbounds "
-		<< expr_type_asm << "* %";
+	stringstream expr_ptr;
+	expr_ptr << "%";
 	if (expr_index >= 0)
-		prologue << expr_index;
+		expr_ptr << expr_index;
 	else
-		prologue << expr_id;
-	prologue << ", i32 0, i32 0" << endl;
-	prologue << "  %" << gen_code_info->tempval_count << " = load "
-		<< iter_type_asm << "* %" << gen_code_info->tempval_count - 1
-		<< ", align 4" << endl;
-	prologue << "  store " << iter_type_asm << " %" << gen_code_info->tempval_count++
-		<< ", " << iter_type_asm << "* %" << iter_id << ", align 4" << endl;
+		expr_ptr << expr_id;
+	int element;
+	if (expr_type->isPacked()) {
+		int word;
+		string mask;
+		prologue << gen_bit_address(gen_code_info, expr_type, expr_ptr.str(), -1, 0, word, mask);
+		prologue << gen_load_bit(gen_code_info, word, mask, element);
+		prologue << "  %" << gen_code_info->tempval_count << " = zext i1 %" << element << " to i8" << endl;
+		element = gen_code_info->tempval_count++;
+	}
+	else {
+		prologue << "  %" << gen_code_info->tempval_count++ << " = getelementptr inbounds "
+			<< expr_type_asm << "* " << expr_ptr.str() << ", i32 0, i32 0" << endl;
+		prologue << "  %" << gen_code_info->tempval_count << " = load "
+			<< iter_type_asm << "* %" << gen_code_info->tempval_count - 1
+			<< ", align " << iter_type->getAlign() << endl;
+		element = gen_code_info->tempval_count++;
+	}
+	prologue << "  store " << iter_type_asm << " %" << element
+		<< ", " << iter_type_asm << "* %" << iter_id << ", align " << iter_type->getAlign() << endl;
+	forget_load(gen_code_info, "%" + iter_id);
+	forget_memory(gen_code_info);
+	map<string, int> invariant = gen_code_info->invariant;
+	map<vector<int>, string> promoted = gen_code_info->promoted;
+	map<vector<int>, PromotedField> fields;
+	prologue << promote_fields(gen_code_info, this, fields);
+	prologue << hoist_invariants(gen_code_info, this);
 	prologue << "  br label %" << gen_code_info->tempval_count << endl;
 	prev_block = gen_code_info->current_block;
 	expr_block = gen_code_info->tempval_count++;
@@ -2871,7 +6088,7 @@ string ASTNodeForEachStmt::gen_code(GenCodeInfo* gen_code_info) {
 		<< count_id << ", align 4" << endl;
 	expr << "  %" << gen_code_info->tempval_count << " = icmp slt i32 %"
 		<< gen_code_info->tempval_count - 1 << ", "
-		<< array_table[expr_type->getValue()]->getLength() << endl;
+		<< expr_type->getLength() << endl;
 	gen_code_info->tempval_count++;
 	expr << "  br i1 %" << gen_code_info->tempval_count - 1
 		<< ", label %" << gen_code_info->tempval_count;
@@ -2901,18 +6118,28 @@ string ASTNodeForEachStmt::gen_code(GenCodeInfo* gen_code_info) {
 		<< gen_code_info->tempval_count - 1 << ", 1" << endl;
 	epilogue << "  store i32 %" << gen_code_info->tempval_count++
 		<< ", i32* %" << count_id << ", align 4" << endl;
-	epilogue << "  %" << gen_code_info->tempval_count++ << " = getelementptr inbounds "
-		<< expr_type_asm << "* %";
-	if (expr_index >= 0)
-		epilogue << expr_index;
-	else
-		epilogue << expr_id;
-	epilogue << ", i32 0, i32 %" << gen_code_info->tempval_count - 2 << endl;
-	epilogue << "  %" << gen_code_info->tempval_count << " = load "
-		<< iter_type_asm << "* %" << gen_code_info->tempval_count - 1
-		<< ", align 4" << endl;
-	epilogue << "  store " << iter_type_asm << " %" << gen_code_info->tempval_count++
-		<< ", " << iter_type_asm << "* %" << iter_id << ", align 4" << endl;
+	if (expr_type->isPacked()) {
+		int word;
+		string mask;
+		epilogue << gen_bit_address(gen_code_info, expr_type, expr_ptr.str(),
+				gen_code_info->tempval_count - 1, 0, word, mask);
+		epilogue << gen_load_bit(gen_code_info, word, mask, element);
+		epilogue << "  %" << gen_code_info->tempval_count << " = zext i1 %" << element << " to i8" << endl;
+		element = gen_code_info->tempval_count++;
+	}
+	else {
+		epilogue << "  %" << gen_code_info->tempval_count++ << " = getelementptr inbounds "
+			<< expr_type_asm << "* " << expr_ptr.str();
+		epilogue << ", i32 0, i32 %" << gen_code_info->tempval_count - 2 << endl;
+		epilogue << "  %" << gen_code_info->tempval_count << " = load "
+			<< iter_type_asm << "* %" << gen_code_info->tempval_count - 1
+			<< ", align " << iter_type->getAlign() << endl;
+		element = gen_code_info->tempval_count++;
+	}
+	epilogue << "  store " << iter_type_asm << " %" << element
+		<< ", " << iter_type_asm << "* %" << iter_id << ", align " << iter_type->getAlign() << endl;
+	forget_load(gen_code_info, "%" + iter_id);
+	forget_memory(gen_code_info);
 	epilogue << "  br label %" << expr_block << endl;
 	end_block = gen_code_info->tempval_count;
 
@@ -2968,10 +6195,13 @@ end:
 	for (int i = gen_code_info->break_point.size() - 1; i >= 0; --i)
 		epilogue << "%" << gen_code_info->break_point[i] << ", ";
 	epilogue << "%" << expr_block << endl;
+	epilogue << store_fields(gen_code_info, fields);
 
 ret:
 	gen_code_info->in_loop = in_loop;
 	gen_code_info->break_point = outer_break_point;
 	gen_code_info->continue_point = outer_continue_point;
+	gen_code_info->invariant = invariant;
+	gen_code_info->promoted = promoted;
 	return prologue.str() + expr.str() + block + loop.str() + epilogue.str();
 }
@@ -5,12 +5,102 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <set>
+#include <unordered_map>
+#include <deque>
 #include <sstream>
 #include <stdexcept>
-#include "location.hh"
+#include <cstdint>
+#include <cstddef>
 
 using namespace std;
 
+// A range of the source file as byte offsets ([begin, end)). Line and column
+// are only needed by diagnostics, so they are computed from line_index when
+// the range is printed.
+struct Location {
+	Location() : begin(0), end(0) {}
+	uint32_t begin;
+	uint32_t end;
+};
+
+ostream& operator<<(ostream& os, const Location& loc);
+
+// offsets at which each line of the source file starts, filled by the lexer
+class LineIndex {
+public:
+	LineIndex() { line_start.push_back(0); }
+	void newline(uint32_t offset) { line_start.push_back(offset); }
+	void lookup(uint32_t offset, uint32_t &line, uint32_t &column) const;
+private:
+	vector<uint32_t> line_start;
+};
+
+extern LineIndex line_index;
+
+class ASTNode;
+
+// Storage shared by all AST nodes, kept as parallel arrays indexed by node.
+// A node's children are the range [child_begin, child_begin + child_count)
+// of child_index; ranges may carry unused capacity while the parser is still
+// appending, compact() re-lays the whole tree out tightly in depth-first order.
+// Identifiers, strings and operators are interned in names and referred to by
+// their index in payload. The node objects themselves are carved out of large
+// blocks (see ASTNode::operator new) and only given back by clear().
+class ASTStore {
+public:
+	~ASTStore() { clear(); }
+
+	void* allocate(size_t size);
+
+	uint32_t add(ASTNode *node, uint8_t kind);
+	void release(uint32_t id) { nodes[id] = NULL; }
+	void append(uint32_t owner, ASTNode *child);
+	void replace(uint32_t owner, uint32_t i, ASTNode *child);
+	void compact(ASTNode *root);
+	void clear();
+
+	ASTNode* node(uint32_t id) const { return nodes[id]; }
+	uint32_t intern(const string &s);
+	const string& name(uint32_t id) const { return names[id]; }
+
+	vector<ASTNode *> nodes;
+	vector<uint8_t> kinds;
+	vector<Location> locs;
+	vector<int32_t> payloads;
+	vector<uint32_t> child_begin;
+	vector<uint32_t> child_count;
+	vector<uint32_t> child_capacity;
+	vector<uint32_t> child_index;
+private:
+	vector<char *> blocks;
+	size_t block_used = 0;
+	// deque so that references to interned strings stay valid
+	deque<string> names;
+	map<string, uint32_t> name_ids;
+};
+
+extern ASTStore ast_store;
+
+// children of a node, viewed through ast_store
+class ChildList {
+public:
+	explicit ChildList(uint32_t owner) : owner(owner) {}
+	uint32_t size() const { return ast_store.child_count[owner]; }
+	bool empty() const { return size() == 0; }
+	ASTNode* operator[](uint32_t i) const {
+		return ast_store.nodes[ast_store.child_index[ast_store.child_begin[owner] + i]];
+	}
+	ASTNode* back() const { return (*this)[size() - 1]; }
+	void push_back(ASTNode *child) { ast_store.append(owner, child); }
+	void replace(uint32_t i, ASTNode *child) { ast_store.replace(owner, i, child); }
+
+	// index of the owning node in ast_store
+	uint32_t owner;
+};
+
+struct ResolveInfo;
+
 class ASTNode {
 public:
 	enum NodeType {
@@ -56,17 +146,19 @@ public:
 		PROGRAM,
 	};
 
-	ASTNode() {}
-	virtual ~ASTNode() {
-		for (int i = 0; i < children.size(); ++i)
-			delete children[i];
-	}
+	explicit ASTNode(NodeType kind) : children(ast_store.add(this, kind)) {}
+	// nodes are owned by ast_store, which also frees the children
+	virtual ~ASTNode() { ast_store.release(children.owner); }
+	static void* operator new(size_t size) { return ast_store.allocate(size); }
+	static void operator delete(void *) {}
 
-	vector<ASTNode *>& getChildren() { return children; }
-	void setLoc(yy::location l) { loc = l; }
-	yy::location getLoc() const { return loc; }
+	ChildList getChildren() const { return children; }
+	uint32_t getIndex() const { return children.owner; }
+	void setIndex(uint32_t id) { children.owner = id; }
+	void setLoc(const Location &l) { ast_store.locs[children.owner] = l; }
+	Location getLoc() const { return ast_store.locs[children.owner]; }
 
-	virtual NodeType type() const = 0;
+	NodeType type() const { return NodeType(ast_store.kinds[children.owner]); }
 	virtual string print() = 0;
 	virtual void traverse_draw_terminal(int i, string prefix = "") {
 		cout << string(i * 4, ' ') << "|-" << prefix << print() << endl;
@@ -77,13 +169,17 @@ public:
 		for (int i = 0; i < children.size(); ++i)
 			children[i]->collect_info();
 	};
+	virtual void resolve(ResolveInfo *info) {
+		for (int i = 0; i < children.size(); ++i)
+			children[i]->resolve(info);
+	}
 protected:
-	vector<ASTNode *> children;
-	yy::location loc;
+	ChildList children;
 };
 
 class ASTNodeList : public ASTNode {
 public:
+	explicit ASTNodeList(NodeType kind) : ASTNode(kind) {}
 	void append(ASTNode *m) {
 		if (m == NULL)
 			throw runtime_error("ASTNodeList: append() called with Nullptr!\n");
@@ -97,20 +193,21 @@ struct GenCodeInfo;
 
 class ASTNodeExpression : public ASTNode {
 public:
+	explicit ASTNodeExpression(NodeType kind) : ASTNode(kind) {}
 	virtual pair<bool, int> eval() = 0; // compute a constant expression
 	virtual string gen_code(GenCodeInfo* gen_code_info);
 };
 
 class ASTNodeExpressionList : public ASTNodeList {
 public:
-	NodeType type() const { return EXPR_LIST; }
+	ASTNodeExpressionList() : ASTNodeList(EXPR_LIST) {}
 	string print() { return string("expr_list") + (children.empty() ? ": No arg!" : ""); }
 };
 
 class ASTNodeBinaryExpr : public ASTNodeExpression {
 public:
 	ASTNodeBinaryExpr(ASTNodeExpression *expr1, ASTNodeExpression *expr2,
-			string o) : op(o) {
+			string o) : ASTNodeExpression(BINARY_EXPR), op(ast_store.name(ast_store.intern(o))) {
 		if (expr1 == NULL || expr2 == NULL)
 			throw runtime_error("ASTNodeBinaryExpr: Constructor called with Nullptr!\n");
 		children.push_back(expr1);
@@ -118,20 +215,22 @@ public:
 	}
 	~ASTNodeBinaryExpr() {}
 
-	NodeType type() const { return BINARY_EXPR; }
 	string print() { return "expr: " + op; }
+	const string& getOp() const { return op; }
 	pair<bool, int> eval();
+	void resolve(ResolveInfo *info);
 
 	string gen_code(GenCodeInfo* gen_code_info);
 private:
 	string gen_assign(GenCodeInfo *gen_code_info);
 	string gen_compute(GenCodeInfo *gen_code_info);
 	string gen_compute_load(GenCodeInfo *gen_code_info, bool &isconstant, bool &isbool, int &value, bool isleft);
-	string op;
+	const string &op;
 };
 
 class ASTNodePrimary : public ASTNodeExpression {
 public:
+	explicit ASTNodePrimary(NodeType kind) : ASTNodeExpression(kind) {}
 	enum LvalType {
 		ID,
 		THISPOINTER,
@@ -140,26 +239,54 @@ public:
 };
 
 class ASTNodeLiteral : public ASTNodePrimary {
+public:
+	explicit ASTNodeLiteral(NodeType kind) : ASTNodePrimary(kind) {}
 };
 
 //------------------------------------------------------------------
 
+class Type;
+class ASTNodeFunctionDefn;
+
+// what an identifier refers to, filled by resolve() before code generation
+struct Binding {
+	enum Kind {
+		UNRESOLVED,
+		LOCAL,    // alloca named after the identifier
+		PARAM,    // parameter at position slot, held in an alloca
+		FIELD,    // member of 'this', reached through path
+		FUNCTION, // global function
+		METHOD    // member function of 'this'
+	};
+	Binding() : kind(UNRESOLVED), slot(0), type(NULL), path(NULL), func(NULL) {}
+	Kind kind;
+	int slot;
+	Type *type;
+	const vector<int> *path;
+	ASTNodeFunctionDefn *func;
+};
+
 class ASTNodeID : public ASTNodePrimary {
 public:
-	ASTNodeID(string s) : id(s) {}
+	ASTNodeID(string s) : ASTNodePrimary(IDENTIFIER) {
+		ast_store.payloads[children.owner] = ast_store.intern(s);
+	}
 	~ASTNodeID() {}
 
-	NodeType type() const { return IDENTIFIER; }
-	string print() { return "ID: " + id; }
-	string getID() { return id; }
+	string print() { return "ID: " + getID(); }
+	const string& getID() { return ast_store.name(getNameId()); }
+	uint32_t getNameId() { return ast_store.payloads[children.owner]; }
 	pair<bool, int> eval() { return make_pair(false, 0); }
+	void resolve(ResolveInfo *info);
+	void resolve_function(ResolveInfo *info);
+	const Binding& getBinding() { return binding; }
 private:
-	string id;
+	Binding binding;
 };
 
 class ASTNodeThis : public ASTNodePrimary {
 public:
-	NodeType type() const { return THIS; }
+	ASTNodeThis() : ASTNodePrimary(THIS) {}
 	string print() { return "this"; }
 	pair<bool, int> eval() { return make_pair(false, 0); }
 };
@@ -176,72 +303,122 @@ public:
 		VOID
 	};
 
-	ASTNodeType(string type) : value(type) {
-		if (type == "integer") {
-			variable_type = INTEGER;
-			asm_str = "i32";
-		}
-		else if (type == "boolean") {
-			variable_type = BOOLEAN;
-			asm_str = "i8";
-		}
-		else
-			variable_type = UNKNOWN;
-	}
-	ASTNodeType(VariableType type) : variable_type(type) {
-		if (type == INTEGER) {
-			value = "integer";
-			asm_str = "i32";
-		}
-		else if (type == BOOLEAN) {
-			value = "boolean";
-			asm_str = "i8";
-		}
-	}
+	ASTNodeType(const string &type);
+	ASTNodeType(VariableType type);
 	~ASTNodeType() {}
 
-	NodeType type() const { return TYPE; }
-	VariableType variableType() { return variable_type; }
-	void setVariableType(VariableType type) {
-		variable_type = type;
-		if (type == INTEGER) {
-			value = "integer";
-			asm_str = "i32";
-		}
-		else if (type == BOOLEAN) {
-			value = "boolean";
-			asm_str = "i8";
-		}
-	}
-	string print() { return "type: " + value; }
-	string getValue() { return value; }
-	void setValue(string type) {
-		value = type;
-		if (type == "integer") {
-			variable_type = INTEGER;
-			asm_str = "i32";
-		}
-		else if (type == "boolean") {
-			variable_type = BOOLEAN;
-			asm_str = "i8";
-		}
-		else
-			variable_type = UNKNOWN;
-	}
-	void setAsm(string as) { asm_str = as; }
-	string getAsm() { return asm_str; }
-	string getTypeAsm(bool array_ref);
+	VariableType variableType();
+	string print() { return "type: " + getValue(); }
+	const string& getValue();
+	const string& getTypeAsm(bool array_ref);
+	Type* getType() { return canonical; }
+private:
+	Type* canonical;
+};
+
+class ASTNodeArrayDecl;
+class ASTNodeClassBody;
+
+// lay out the fields of each class by decreasing alignment instead of
+// declaration order, set by -freorder-fields
+extern bool reorder_fields;
+// store arrays of booleans as bitsets of i32 words, set by -fpack-bool-arrays
+extern bool pack_bool_arrays;
+
+// Members of a class with inheritance flattened, keyed by the interned name
+// (see ASTStore::intern). Built on first use after gen_typedef() and never
+// modified afterwards.
+struct ClassLayout {
+	struct Field {
+		// struct indices following the leading 'i32 0' of the getelementptr
+		vector<int> path;
+		int offset;
+		// 0 for members of the class itself, 1 for those of its super class, ...
+		int depth;
+		// position of the declaration within its class
+		int index;
+		Type *type;
+	};
+	struct Method {
+		int depth;
+		// the class defining the method
+		Type *owner;
+		ASTNodeFunctionDefn *func;
+	};
+	unordered_map<uint32_t, Field> fields;
+	unordered_map<uint32_t, Method> methods;
+	int size;
+	int align;
+};
+
+// There is exactly one Type per distinct type of the program, shared by all
+// the ASTNodeType naming it, so types are compared by pointer. Array and
+// class types stay UNKNOWN until ASTNodeProgram::gen_typedef() resolves them.
+class Type {
+public:
+	static Type* get(const string &name);
+	static Type* get(ASTNodeType::VariableType type);
+
+	ASTNodeType::VariableType variableType() const { return variable_type; }
+	const string& getValue() const { return value; }
+	const string& getAsm() const { return asm_str; }
+	// arrays are passed to functions by pointer
+	const string& getTypeAsm(bool array_ref) const { return array_ref ? ref_asm_str : asm_str; }
+	// type of values in registers and of parameters, booleans are i1 there
+	const string& getRegAsm() const { return reg_asm_str; }
+	int getSize();
+	int getAlign();
+	// alignment of getTypeAsm(array_ref)
+	int getAlign(bool array_ref);
+
+	// array types
+	void setArray(ASTNodeArrayDecl *decl, Type *element, int length);
+	void setAsm(const string &as);
+	ASTNodeArrayDecl* getArrayDecl() const { return array_decl; }
+	Type* getElement() const { return element; }
+	int getLength() const { return length; }
+	// element i is bit i % 32 of the i32 word i / 32
+	bool isPacked() const { return packed; }
+
+	// class types
+	void setClass(ASTNodeClassBody *body, Type *super);
+	ASTNodeClassBody* getClassBody() const { return class_body; }
+	Type* getSuper() const { return super; }
+	const ClassLayout& getLayout();
 private:
-	VariableType variable_type;
+	Type(const string &value, ASTNodeType::VariableType type, const string &as);
+	void compute_layout();
+
+	ASTNodeType::VariableType variable_type;
 	string value;
 	string asm_str;
+	string ref_asm_str;
+	string reg_asm_str;
+	// -1 until computed
+	int size;
+	int align;
+
+	ASTNodeArrayDecl *array_decl;
+	Type *element;
+	int length;
+	bool packed;
+
+	ASTNodeClassBody *class_body;
+	Type *super;
+	ClassLayout *layout;
 };
 
+inline ASTNodeType::ASTNodeType(const string &type) : ASTNode(TYPE), canonical(Type::get(type)) {}
+inline ASTNodeType::ASTNodeType(VariableType type) : ASTNode(TYPE), canonical(Type::get(type)) {}
+inline ASTNodeType::VariableType ASTNodeType::variableType() { return canonical->variableType(); }
+inline const string& ASTNodeType::getValue() { return canonical->getValue(); }
+inline const string& ASTNodeType::getTypeAsm(bool array_ref) { return canonical->getTypeAsm(array_ref); }
+
 //-----------------------------primary Begin-------------------------------------
 
 class ASTNodeFieldAccess : public ASTNodePrimary {
 public:
-	ASTNodeFieldAccess(ASTNodePrimary *pri, ASTNodeID *id) {
+	ASTNodeFieldAccess(ASTNodePrimary *pri, ASTNodeID *id) : ASTNodePrimary(FIELD_ACCESS) {
 		if (pri == NULL || id == NULL)
 			throw runtime_error("ASTNodeFieldAccess: Constructor called with Nullptr!\n");
 		children.push_back(pri);
@@ -249,9 +426,9 @@ public:
 	}
 	~ASTNodeFieldAccess() {}
 
-	NodeType type() const { return FIELD_ACCESS; }
 	string print() { return "field access"; }
 	pair<bool, int> eval() { return make_pair(false, 0); }
+	void resolve(ResolveInfo *info) { children[0]->resolve(info); }
 	string gen_code(GenCodeInfo* gen_code_info);
 private:
 	string gen_simple(GenCodeInfo *gen_code_info);
@@ -261,7 +438,7 @@ private:
 
 class ASTNodeArrayAccess : public ASTNodePrimary {
 public:
-	ASTNodeArrayAccess(ASTNodePrimary *pri, ASTNodeExpression *expr) {
+	ASTNodeArrayAccess(ASTNodePrimary *pri, ASTNodeExpression *expr) : ASTNodePrimary(ARRAY_ACCESS) {
 		if (pri == NULL || expr == NULL)
 			throw runtime_error("ASTNodeArrayAccess: Constructor called with Nullptr!\n");
 		children.push_back(pri);
@@ -269,7 +446,6 @@ public:
 	}
 	~ASTNodeArrayAccess() {}
 
-	NodeType type() const { return ARRAY_ACCESS; }
 	string print() { return "array access"; }
 	pair<bool, int> eval() { return make_pair(false, 0); }
 
@@ -280,20 +456,20 @@ public:
 	}
 	string gen_code(GenCodeInfo* gen_code_info);
 private:
-	void check_type(GenCodeInfo* gen_code_info, ASTNodeType* type);
+	void check_type(GenCodeInfo* gen_code_info, Type* type);
 	string gen_simple(GenCodeInfo *gen_code_info);
 	string gen_asm(GenCodeInfo* gen_code_info, LvalType lvaltype);
 };
 
 class ASTNodeMethodInvocation : public ASTNodePrimary {
 public:
-	ASTNodeMethodInvocation(ASTNodeID *id, ASTNodeExpressionList *expr_list) {
+	ASTNodeMethodInvocation(ASTNodeID *id, ASTNodeExpressionList *expr_list) : ASTNodePrimary(METHOD_INVOCATION) {
 		if (id == NULL || expr_list == NULL)
 			throw runtime_error("ASTNodeMethodInvocation: Constructor called with Nullptr!\n");
 		children.push_back(id);
 		children.push_back(expr_list);
 	}
-	ASTNodeMethodInvocation(ASTNodeFieldAccess *facc, ASTNodeExpressionList *expr_list) {
+	ASTNodeMethodInvocation(ASTNodeFieldAccess *facc, ASTNodeExpressionList *expr_list) : ASTNodePrimary(METHOD_INVOCATION) {
 		if (facc == NULL || expr_list == NULL)
 			throw runtime_error("ASTNodeMethodInvocation: Constructor called with Nullptr!\n");
 		children.push_back(facc);
@@ -301,7 +477,6 @@ public:
 	}
 	~ASTNodeMethodInvocation() {}
 
-	NodeType type() const { return METHOD_INVOCATION; }
 	string print() { return "method invocation"; }
 	pair<bool, int> eval() { return make_pair(false, 0); }
 
@@ -310,6 +485,7 @@ public:
 		children[0]->traverse_draw_terminal(i + 1, "method: ");
 		children[1]->traverse_draw_terminal(i + 1, "args: ");
 	}
+	void resolve(ResolveInfo *info);
 	string gen_code(GenCodeInfo* gen_code_info);
 private:
 };
@@ -319,51 +495,44 @@ private:
 
 class ASTNodeInteger : public ASTNodeLiteral {
 public:
-	ASTNodeInteger(int i) : value(i) {}
+	ASTNodeInteger(int i) : ASTNodeLiteral(INTEGER) { ast_store.payloads[children.owner] = i; }
 	~ASTNodeInteger() {}
 
-	NodeType type() const { return INTEGER; }
-	int getValue() { return value; }
+	int getValue() { return ast_store.payloads[children.owner]; }
 	string print() {
 		stringstream ss;
-		ss << value;
+		ss << getValue();
 		return "INT: " + ss.str();
 	}
-	pair<bool, int> eval() { return make_pair(true, value); }
-private:
-	int value;
+	pair<bool, int> eval() { return make_pair(true, getValue()); }
 };
 
 class ASTNodeBoolean : public ASTNodeLiteral {
 public:
-	ASTNodeBoolean(bool i) : value(i) {}
+	ASTNodeBoolean(bool i) : ASTNodeLiteral(BOOLEAN) { ast_store.payloads[children.owner] = i; }
 	~ASTNodeBoolean() {}
 
-	NodeType type() const { return BOOLEAN; }
-	bool getValue() { return value; }
+	bool getValue() { return ast_store.payloads[children.owner] != 0; }
 	string print() {
-		if (value)
+		if (getValue())
 			return "BOOL: true";
 		else
 			return "BOOL: false";
 	}
-	pair<bool, int> eval() { return make_pair(true, value); }
-private:
-	bool value;
+	pair<bool, int> eval() { return make_pair(true, getValue()); }
 };
 
 class ASTNodeString : public ASTNodeLiteral {
 public:
-	ASTNodeString(string s) : value(s) {}
+	ASTNodeString(string s) : ASTNodeLiteral(STRING) {
+		ast_store.payloads[children.owner] = ast_store.intern(s);
+	}
 	~ASTNodeString() {}
 
-	NodeType type() const { return STRING; }
-	string getValue() { return value; }
-	string print() { return "STRING: " + value; }
+	const string& getValue() { return ast_store.name(ast_store.payloads[children.owner]); }
+	string print() { return "STRING: " + getValue(); }
 	pair<bool, int> eval() { return make_pair(false, 0); }
 	void collect_info();
-private:
-	string value;
 };
 
 //----------------------------literal End-------------------------------------
@@ -371,12 +540,13 @@ private:
 
 class ASTNodeStatement : public ASTNode {
 public:
+	explicit ASTNodeStatement(NodeType kind) : ASTNode(kind) {}
 	virtual string gen_code(GenCodeInfo* gen_code_info) = 0;
 };
 
 class ASTNodeBlock : public ASTNodeList {
 public:
-	NodeType type() const { return BLOCK; }
+	ASTNodeBlock() : ASTNodeList(BLOCK) {}
 	string print() { return string("block") + (children.empty() ? ": Empty block!" : ""); }
 	string gen_code(GenCodeInfo* gen_code_info);
 };
@@ -385,7 +555,7 @@ public:
 
 class ASTNodeElifList : public ASTNodeList {
 public:
-	ASTNodeElifList(ASTNodeExpression *expr, ASTNodeBlock *blk) { append(expr, blk); }
+	ASTNodeElifList(ASTNodeExpression *expr, ASTNodeBlock *blk) : ASTNodeList(ELIF_LIST) { append(expr, blk); }
 	~ASTNodeElifList() {}
 
 	void append(ASTNodeExpression *expr, ASTNodeBlock *blk) {
@@ -394,13 +564,12 @@ public:
 		children.push_back(expr);
 		children.push_back(blk);
 	}
-	NodeType type() const { return ELIF_LIST; }
 	string print() { return "elif list"; }
 };
 
 class ASTNodeIfThenElseStmt : public ASTNodeStatement {
 public:
-	ASTNodeIfThenElseStmt(ASTNodeExpression *expr, ASTNodeBlock *blk1, ASTNodeBlock *blk2) {
+	ASTNodeIfThenElseStmt(ASTNodeExpression *expr, ASTNodeBlock *blk1, ASTNodeBlock *blk2) : ASTNodeStatement(IF_THEN_ELSE_STMT) {
 		if (expr == NULL || blk1 == NULL)
 			throw runtime_error("ASTNodeIfThenElseStmt: Constructor called with Nullptr!\n");
 		children.push_back(expr);
@@ -408,19 +577,18 @@ public:
 		if (blk2)
 			children.push_back(blk2);
 	}
-	ASTNodeIfThenElseStmt(ASTNodeExpression *expr, ASTNodeBlock *blk1, ASTNodeElifList *elif, ASTNodeBlock *blk2) {
+	ASTNodeIfThenElseStmt(ASTNodeExpression *expr, ASTNodeBlock *blk1, ASTNodeElifList *elif, ASTNodeBlock *blk2) : ASTNodeStatement(IF_THEN_ELSE_STMT) {
 		if (expr == NULL || blk1 == NULL || elif == NULL || blk2 == NULL)
 			throw runtime_error("ASTNodeIfThenElseStmt: Constructor called with Nullptr!\n");
 		children.push_back(expr);
 		children.push_back(blk1);
-		vector<ASTNode *>& elif_children = elif->getChildren();
+		ChildList elif_children = elif->getChildren();
 		for (int i = 0; i < elif_children.size(); ++i)
 			children.push_back(elif_children[i]);
 		children.push_back(blk2);
 	}
 	~ASTNodeIfThenElseStmt() {}
 
-	NodeType type() const { return IF_THEN_ELSE_STMT; }
 	string print() {
 		if (children.size() == 2)
 			return "if then statement";
@@ -451,13 +619,15 @@ public:
 		cout << string(i * 4 + 4, ' ') << "|-" << "KEYWORD: end if" << endl;
 	}
 	string gen_code(GenCodeInfo* gen_code_info);
+private:
+	string gen_switch(GenCodeInfo* gen_code_info, ASTNodeID *id, const vector<int> &cases);
 };
 
 //------------------Iteration Statement-------------------------
 
 class ASTNodeWhileStmt : public ASTNodeStatement {
 public:
-	ASTNodeWhileStmt(ASTNodeExpression *expr, ASTNodeBlock *blk) {
+	ASTNodeWhileStmt(ASTNodeExpression *expr, ASTNodeBlock *blk) : ASTNodeStatement(WHILE_STMT) {
 		if (expr == NULL || blk == NULL)
 			throw runtime_error("ASTNodeWhileStmt: Constructor called with Nullptr!\n");
 		children.push_back(expr);
@@ -465,7 +635,6 @@ public:
 	}
 	~ASTNodeWhileStmt() {}
 
-	NodeType type() const { return WHILE_STMT; }
 	string print() { return "while statement"; }
 
 	void traverse_draw_terminal(int i, string prefix = "") {
@@ -481,7 +650,7 @@ public:
 
 class ASTNodeRepeatStmt : public ASTNodeStatement {
 public:
-	ASTNodeRepeatStmt(ASTNodeBlock *blk, ASTNodeExpression *expr) {
+	ASTNodeRepeatStmt(ASTNodeBlock *blk, ASTNodeExpression *expr) : ASTNodeStatement(REPEAT_STMT) {
 		if (blk == NULL || expr == NULL)
 			throw runtime_error("ASTNodeRepeatStmt: Constructor called with Nullptr!\n");
 		children.push_back(blk);
@@ -489,7 +658,6 @@ public:
 	}
 	~ASTNodeRepeatStmt() {}
 
-	NodeType type() const { return REPEAT_STMT; }
 	string print() { return "repeat statement"; }
 
 	void traverse_draw_terminal(int i, string prefix = "") {
@@ -504,7 +672,7 @@ public:
 
 class ASTNodeForEachStmt : public ASTNodeStatement {
 public:
-	ASTNodeForEachStmt(ASTNodeID *id, ASTNodeExpression *expr, ASTNodeBlock *blk) {
+	ASTNodeForEachStmt(ASTNodeID *id, ASTNodeExpression *expr, ASTNodeBlock *blk) : ASTNodeStatement(FOREACH_STMT) {
 		if (id == NULL || expr == NULL || blk == NULL)
 			throw runtime_error("ASTNodeForEachStmt: Constructor called with Nullptr!\n");
 		children.push_back(id);
@@ -513,7 +681,6 @@ public:
 	}
 	~ASTNodeForEachStmt() {}
 
-	NodeType type() const { return FOREACH_STMT; }
 	string print() { return "foreach statement"; }
 
 	void traverse_draw_terminal(int i, string prefix = "") {
@@ -533,39 +700,37 @@ public:
 
 class ASTNodeBreakStmt : public ASTNodeStatement {
 public:
-	NodeType type() const { return BREAK_STMT; }
+	ASTNodeBreakStmt() : ASTNodeStatement(BREAK_STMT) {}
 	string print() { return "break statement"; }
 	string gen_code(GenCodeInfo* gen_code_info);
 };
 
 class ASTNodeContinueStmt : public ASTNodeStatement {
 public:
-	NodeType type() const { return CONTINUE_STMT; }
+	ASTNodeContinueStmt() : ASTNodeStatement(CONTINUE_STMT) {}
 	string print() { return "continue statement"; }
 	string gen_code(GenCodeInfo* gen_code_info);
 };
 
 class ASTNodeReturnStmt : public ASTNodeStatement {
 public:
-	ASTNodeReturnStmt() {}
-	ASTNodeReturnStmt(ASTNodeExpression *expr) { children.push_back(expr); }
+	ASTNodeReturnStmt() : ASTNodeStatement(RETURN_STMT) {}
+	ASTNodeReturnStmt(ASTNodeExpression *expr) : ASTNodeStatement(RETURN_STMT) { children.push_back(expr); }
 	~ASTNodeReturnStmt() {}
 
-	NodeType type() const { return RETURN_STMT; }
 	string print() { return "return statement"; }
 	string gen_code(GenCodeInfo* gen_code_info);
 };
 
 class ASTNodePrintStmt : public ASTNodeStatement {
 public:
-	ASTNodePrintStmt(ASTNodeExpressionList *expr_list) {
+	ASTNodePrintStmt(ASTNodeExpressionList *expr_list) : ASTNodeStatement(PRINT_STMT) {
 		if (expr_list == NULL)
 			throw runtime_error("ASTNodePrintStmt: Constructor called with Nullptr!\n");
 		children.push_back(expr_list);
 	}
 	~ASTNodePrintStmt() {}
 
-	NodeType type() const { return PRINT_STMT; }
 	string print() { return "print statement"; }
 
 	void traverse_draw_terminal(int i, string prefix = "") {
@@ -573,25 +738,23 @@ public:
 		cout << string(i * 4 + 4, ' ') << "|-" << "KEYWORD: print" << endl;
 		children[0]->traverse_draw_terminal(i + 1);
 	}
+	void collect_info();
 	string gen_code(GenCodeInfo* gen_code_info);
 private:
 	string gen_code(GenCodeInfo* gen_code_info, ASTNodeExpression* expr);
 	string gen_simple(GenCodeInfo* gen_code_info);
 	string gen_composed(GenCodeInfo* gen_code_info);
+	string gen_text(const string &text);
+	// adjacent literal arguments merged into one string each
+	vector<string> texts;
 };
 
 class ASTNodeExpressionStmt : public ASTNodeStatement {
 public:
-	ASTNodeExpressionStmt() {}
-	ASTNodeExpressionStmt(ASTNodeExpression *expr) { children.push_back(expr); }
+	ASTNodeExpressionStmt() : ASTNodeStatement(EMPTY_STMT) {}
+	ASTNodeExpressionStmt(ASTNodeExpression *expr) : ASTNodeStatement(EXPR_STMT) { children.push_back(expr); }
 	~ASTNodeExpressionStmt() {}
 
-	NodeType type() const {
-		if (children.empty())
-			return EMPTY_STMT;
-		else
-			return EXPR_STMT;
-	}
 	string print() {
 		if (children.empty())
 			return "empty statement";
@@ -610,20 +773,24 @@ public:
 //------------------------------declaration Begin------------------------------
 
 class ASTNodeDeclaration : public ASTNode {
+public:
+	explicit ASTNodeDeclaration(NodeType kind) : ASTNode(kind) {}
 };
 
 class ASTNodeDeclList : public ASTNodeList {
+public:
+	explicit ASTNodeDeclList(NodeType kind) : ASTNodeList(kind) {}
 };
 
 class ASTNodeParameterList : public ASTNodeList {
 public:
-	NodeType type() const { return PARAM_LIST; }
+	ASTNodeParameterList() : ASTNodeList(PARAM_LIST) {}
 	string print() { return string("parameter list") + (children.empty() ? ": No param!" : ""); }
 };
 
 class ASTNodeVariableDecl : public ASTNodeDeclaration {
 public:
-	ASTNodeVariableDecl (ASTNodeID *id, ASTNodeType *type) {
+	ASTNodeVariableDecl (ASTNodeID *id, ASTNodeType *type) : ASTNodeDeclaration(VARIABLE_DECL) {
 		if (id == NULL || type == NULL)
 			throw runtime_error("ASTNodeVariableDecl: Constructor called with Nullptr!\n");
 		children.push_back(id);
@@ -631,7 +798,6 @@ public:
 	}
 	~ASTNodeVariableDecl() {}
 
-	NodeType type() const { return VARIABLE_DECL; }
 	string print() { return "variable declaration";}
 
 	void traverse_draw_terminal(int i, string prefix = "") {
@@ -645,19 +811,18 @@ public:
 
 class ASTNodeVariableDeclList : public ASTNodeDeclList {
 public:
-	NodeType type() const { return VARIABLE_DECL_LIST; }
+	ASTNodeVariableDeclList() : ASTNodeDeclList(VARIABLE_DECL_LIST) {}
 	string print() { return string("variable declaration list") +
 		(children.empty() ? ": No decl!" : ""); }
 };
 
 class ASTNodeClassDecl;
-class ASTNodeClassBody;
 
 class ASTNodeFunctionDefn : public ASTNodeDeclaration {
 public:
 	ASTNodeFunctionDefn(ASTNodeID *id, ASTNodeParameterList *param_list,
 			ASTNodeVariableDeclList *param_decl, ASTNodeType *type,
-			ASTNodeVariableDeclList *local_decl, ASTNodeBlock *blk) {
+			ASTNodeVariableDeclList *local_decl, ASTNodeBlock *blk) : ASTNodeDeclaration(FUNC_DEFN) {
 		if (id == NULL || param_list == NULL || param_decl == NULL || type ==
 				NULL || local_decl == NULL || blk == NULL)
 			throw runtime_error("ASTNodeFunctionDecl: Constructor called with Nullptr!\n");
@@ -670,7 +835,6 @@ public:
 	}
 	~ASTNodeFunctionDefn() {}
 
-	NodeType type() const { return FUNC_DEFN; }
 	string print() { return "function definition"; }
 
 	void traverse_draw_terminal(int i, string prefix = "") {
@@ -694,16 +858,19 @@ public:
 	map<string, pair<int, ASTNodeType*>>* getParams() { return &params; }
 	void collect_info();
 	void collect_info(map<string, ASTNodeFunctionDefn*> &func_table);
+	void resolve(Type *this_type = NULL, ASTNodeClassBody *class_body = NULL);
 	void gen_code(string class_id = "", ASTNodeClassBody *class_body = NULL);
 private:
 	map<string, pair<int, ASTNodeType*>> params;
 	map<string, ASTNodeType*> localvar_table;
+	// parameters which may be modified, found by resolve()
+	set<string> written_params;
 };
 
 class ASTNodeArrayDecl : public ASTNodeDeclaration {
 public:
 	ASTNodeArrayDecl(ASTNodeID *id, ASTNodeExpression *expr, ASTNodeType *type)
-	: length(0), indegree(0) {
+	: ASTNodeDeclaration(ARRAY_DECL), length(0), type(NULL), indegree(0) {
 		if (id == NULL || expr == NULL || type == NULL)
 			throw runtime_error("ASTNodeFunctionDecl: Constructor called with Nullptr!\n");
 		children.push_back(id);
@@ -712,7 +879,6 @@ public:
 	}
 	~ASTNodeArrayDecl() {}
 
-	NodeType type() const { return ARRAY_DECL; }
 	string print() { return "array declaration: "; }
 
 	void traverse_draw_terminal(int i, string prefix = "") {
@@ -726,6 +892,7 @@ public:
 	void collect_info();
 
 	int getLength() { return length; }
+	Type* getType() { return type; }
 	void depend(ASTNodeArrayDecl* vertex) {
 		indegree++;
 		vertex->depender.push_back(this);
@@ -735,6 +902,7 @@ public:
 	vector<ASTNodeArrayDecl*>& getDepender() { return depender; }
 private:
 	int length;
+	Type *type;
 
 	// to construct array dependency graph
 	vector<ASTNodeArrayDecl*> depender;
@@ -743,10 +911,9 @@ private:
 
 class ASTNodeClassBody : public ASTNodeDeclList {
 public:
-	ASTNodeClassBody() : indegree(0), visited(false) {}
+	ASTNodeClassBody() : ASTNodeDeclList(CLASS_BODY), indegree(0), visited(false) {}
 	~ASTNodeClassBody() {}
 
-	NodeType type() const { return CLASS_BODY; }
 	string print() { return string("class body: ") + (children.empty() ? ": Empty class body!" : ""); }
 	void collect_info();
 	void merge(ASTNodeClassBody* super);
@@ -806,7 +973,7 @@ private:
 
 class ASTNodeClassDecl : public ASTNodeDeclaration {
 public:
-	ASTNodeClassDecl(ASTNodeID *id, ASTNodeType *super, ASTNodeClassBody *body) {
+	ASTNodeClassDecl(ASTNodeID *id, ASTNodeType *super, ASTNodeClassBody *body) : ASTNodeDeclaration(CLASS_DECL) {
 		if (id == NULL || super == NULL || body == NULL)
 			throw runtime_error("ASTNodeClassDecl: Constructor called with Nullptr!\n");
 		children.push_back(id);
@@ -815,7 +982,6 @@ public:
 	}
 	~ASTNodeClassDecl() {}
 
-	NodeType type() const { return CLASS_DECL; }
 	string print() { return "class declaration: "; }
 
 	void traverse_draw_terminal(int i, string prefix = "") {
@@ -837,7 +1003,7 @@ public:
 
 class ASTNodeCompoundDeclList : public ASTNodeDeclList {
 public:
-	NodeType type() const { return COMPOUND_DECL_LIST; }
+	ASTNodeCompoundDeclList() : ASTNodeDeclList(COMPOUND_DECL_LIST) {}
 	string print() { return string("global declarations: ") + (children.empty() ? ": No decl!": ""); }
 };
 
@@ -846,7 +1012,7 @@ public:
 class ASTNodeProgram : public ASTNode {
 public:
 	ASTNodeProgram(ASTNodeID *id, ASTNodeCompoundDeclList *cmpd_decl,
-			ASTNodeVariableDeclList *local_decl, ASTNodeBlock *blk) {
+			ASTNodeVariableDeclList *local_decl, ASTNodeBlock *blk) : ASTNode(PROGRAM) {
 		if (id == NULL || cmpd_decl == NULL || local_decl == NULL || blk == NULL)
 			throw runtime_error("ASTNodeProgram: Constructor called with Nullptr!\n");
 		children.push_back(id);
@@ -856,7 +1022,6 @@ public:
 	}
 	~ASTNodeProgram() {}
 
-	NodeType type() const { return PROGRAM; }
 	string print() { return "program: "; }
 
 	void traverse_draw_terminal(int i, string prefix = "") {
@@ -7,28 +7,41 @@ extern FILE *yyin;
 extern ASTNode *ast_root;
 
 int main(int argc, char **argv) {
-	if (argc <= 3) {
-		cout << "Usage: " << argv[0] << " source AST_output llvm_asm_output" << endl;
+	int arg = 1;
+	for (; arg < argc && argv[arg][0] == '-'; ++arg) {
+		if (string(argv[arg]) == "-freorder-fields")
+			reorder_fields = true;
+		else if (string(argv[arg]) == "-fpack-bool-arrays")
+			pack_bool_arrays = true;
+		else {
+			cout << "Unknown option: " << argv[arg] << endl;
+			return 1;
+		}
+	}
+	if (argc - arg < 3) {
+		cout << "Usage: " << argv[0] << " [-freorder-fields] [-fpack-bool-arrays] source AST_output llvm_asm_output" << endl;
 		return 1;
 	}
 
-	yyin = fopen(argv[1], "r");
+	yyin = fopen(argv[arg], "r");
 	streambuf *saved_cout = cout.rdbuf();
 	ofstream output;
-	output.open(argv[2], output.out | output.trunc);
+	output.open(argv[arg + 1], output.out | output.trunc);
 	cout.rdbuf(output.rdbuf());
 
 	yy::parser parser;
 	//parser.set_debug_level(1);
 	parser.parse();
-	if (ast_root)
+	if (ast_root) {
+		ast_store.compact(ast_root);
 		ast_root->traverse_draw_terminal(0);
+	}
 
 	cout.rdbuf(saved_cout);
 	output.close();
 
 	saved_cout = cout.rdbuf();
-	output.open(argv[3], output.out | output.trunc);
+	output.open(argv[arg + 2], output.out | output.trunc);
 	cout.rdbuf(output.rdbuf());
 
 	try {
@@ -40,7 +53,7 @@ int main(int argc, char **argv) {
 	catch (runtime_error &e) {
 		cout.rdbuf(saved_cout);
 		output.close();
-		output.open(argv[3], output.out | output.trunc);
+		output.open(argv[arg + 2], output.out | output.trunc);
 		output << e.what();
 		output.close();
 		return -1;
@@ -1,10 +1,11 @@
-%code top{
+%code requires{
 	#include "ast.h"
 }
 
 %require "3.0"
 %language "C++"
 %locations
+%define api.location.type {Location}
 %error-verbose
 /*%define parse.trace
 %debug*/